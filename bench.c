@@ -0,0 +1,424 @@
+#include "heap.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Co ile operacji obciążenie odczytuje zajętość pamięci alokatora
+#define OKRES_PROBKOWANIA 4096
+#define ROZMIAR_KOLEJKI 1024
+
+struct alokator_t {
+    const char *nazwa;
+    void *(*przydziel)(size_t rozmiar);
+    void (*zwolnij)(void *wskaznik);
+    void *(*zmien_rozmiar)(void *wskaznik, size_t rozmiar);
+    size_t (*zajetosc)(void);
+    int wielowatkowy;
+};
+
+// Wyniki jednego uruchomienia obciążenia - czasy pojedynczych operacji w nanosekundach; pomiar z ustawionym
+// bez_zywych tylko mierzy czas, a żywe bajty liczy za niego inny pomiar
+struct pomiar_t {
+    uint32_t *czasy;
+    size_t operacje;
+    size_t pojemnosc;
+    int bez_zywych;
+    size_t zywe_bajty;
+    size_t szczyt_zywych;
+    size_t szczyt_zajetosci;
+};
+
+struct obciazenie_t {
+    const char *nazwa;
+    void (*wykonaj)(const struct alokator_t *alokator, struct pomiar_t *pomiar, size_t bloki);
+    size_t bloki;
+    size_t operacje;
+};
+
+static size_t heap_zajetosc(void) {
+    // Sterta i odwzorowania dużych bloków - liczniki heap_stats, bez przechodzenia listy
+    struct heap_stats_t statystyki;
+    if (heap_stats(&statystyki) != 0) {
+        return 0;
+    }
+    return statystyki.heap_size + statystyki.mmap_bytes;
+}
+static size_t libc_zajetosc(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 informacje = mallinfo2();
+    return informacje.arena + informacje.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+static const struct alokator_t alokatory[] = {
+        {"heap", heap_malloc, heap_free, heap_realloc, heap_zajetosc,
+#ifdef HEAP_THREAD_SAFE
+         1
+#else
+         0
+#endif
+        },
+        {"libc", malloc, free, realloc, libc_zajetosc, 1}
+};
+
+static uint64_t teraz(void) {
+    struct timespec czas;
+    clock_gettime(CLOCK_MONOTONIC, &czas);
+    return (uint64_t) czas.tv_sec * 1000000000u + (uint64_t) czas.tv_nsec;
+}
+static uint64_t losowa(uint64_t *stan) {
+    // xorshift64* - szybki generator, by losowanie nie dominowało czasu obciążenia
+    *stan ^= *stan >> 12;
+    *stan ^= *stan << 25;
+    *stan ^= *stan >> 27;
+    return *stan * 0x2545F4914F6CDD1Dull;
+}
+static size_t losowy_rozmiar(uint64_t *stan) {
+    // Przeważają małe obiekty, z domieszką średnich i rzadkich dużych
+    uint64_t los = losowa(stan);
+    unsigned procent = (unsigned) (los % 100);
+    los >>= 8;
+    if (procent < 80) {
+        return 16 + los % 497;
+    }
+    if (procent < 98) {
+        return 512 + los % 7681;
+    }
+    return 8192 + los % (256 * 1024 - 8191);
+}
+static void *tablica(size_t bajty) {
+    // Pamięć pomocnicza pochodzi prosto z mmap, by nie zaburzać pomiaru żadnego z alokatorów
+    void *pamiec = mmap(NULL, bajty, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pamiec == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    return pamiec;
+}
+static void uzyj(void *wskaznik, size_t rozmiar) {
+    // Zapis początku bloku - pamięć musi zostać faktycznie dotknięta
+    if (wskaznik != NULL) {
+        memset(wskaznik, 0x5a, rozmiar < 64 ? rozmiar : 64);
+    }
+}
+
+static void pomiar_zapisz(struct pomiar_t *pomiar, uint64_t poczatek) {
+    uint64_t czas = teraz() - poczatek;
+    if (pomiar->operacje < pomiar->pojemnosc) {
+        pomiar->czasy[pomiar->operacje] = czas > UINT32_MAX ? UINT32_MAX : (uint32_t) czas;
+    }
+    pomiar->operacje++;
+}
+static void pomiar_probkuj(const struct alokator_t *alokator, struct pomiar_t *pomiar) {
+    if (pomiar->zywe_bajty > pomiar->szczyt_zywych) {
+        pomiar->szczyt_zywych = pomiar->zywe_bajty;
+    }
+    if (pomiar->operacje % OKRES_PROBKOWANIA == 0) {
+        size_t zajetosc = alokator->zajetosc();
+        if (zajetosc > pomiar->szczyt_zajetosci) {
+            pomiar->szczyt_zajetosci = zajetosc;
+        }
+    }
+}
+static void *pomiar_przydziel(const struct alokator_t *alokator, struct pomiar_t *pomiar, size_t rozmiar) {
+    uint64_t poczatek = teraz();
+    void *wskaznik = alokator->przydziel(rozmiar);
+    pomiar_zapisz(pomiar, poczatek);
+    if (wskaznik != NULL) {
+        pomiar->zywe_bajty += rozmiar;
+    }
+    pomiar_probkuj(alokator, pomiar);
+    uzyj(wskaznik, rozmiar);
+    return wskaznik;
+}
+static void pomiar_zwolnij(const struct alokator_t *alokator, struct pomiar_t *pomiar, void *wskaznik, size_t rozmiar) {
+    uint64_t poczatek = teraz();
+    alokator->zwolnij(wskaznik);
+    pomiar_zapisz(pomiar, poczatek);
+    if (wskaznik != NULL && !pomiar->bez_zywych) {
+        pomiar->zywe_bajty -= rozmiar;
+    }
+    pomiar_probkuj(alokator, pomiar);
+}
+static void *pomiar_zmien_rozmiar(const struct alokator_t *alokator, struct pomiar_t *pomiar, void *wskaznik,
+                                  size_t stary_rozmiar, size_t rozmiar) {
+    uint64_t poczatek = teraz();
+    void *nowy = alokator->zmien_rozmiar(wskaznik, rozmiar);
+    pomiar_zapisz(pomiar, poczatek);
+    if (nowy != NULL) {
+        pomiar->zywe_bajty += rozmiar - stary_rozmiar;
+    }
+    pomiar_probkuj(alokator, pomiar);
+    return nowy;
+}
+
+static void obciazenie_losowe(const struct alokator_t *alokator, struct pomiar_t *pomiar, size_t bloki) {
+    // Losowe przydziały i zwolnienia na stałej liczbie miejsc - połowa zajęta w stanie ustalonym
+    void **wskazniki = tablica(bloki * sizeof(void *));
+    size_t *rozmiary = tablica(bloki * sizeof(size_t));
+    uint64_t stan = 0x9e3779b97f4a7c15ull;
+    size_t operacje = pomiar->pojemnosc;
+
+    for (size_t i = 0; i < operacje; i++) {
+        size_t miejsce = losowa(&stan) % bloki;
+        if (wskazniki[miejsce] == NULL) {
+            rozmiary[miejsce] = losowy_rozmiar(&stan);
+            wskazniki[miejsce] = pomiar_przydziel(alokator, pomiar, rozmiary[miejsce]);
+        } else {
+            pomiar_zwolnij(alokator, pomiar, wskazniki[miejsce], rozmiary[miejsce]);
+            wskazniki[miejsce] = NULL;
+        }
+    }
+    for (size_t i = 0; i < bloki; i++) {
+        alokator->zwolnij(wskazniki[i]);
+    }
+}
+
+struct kolejka_t {
+    _Atomic size_t glowa;
+    _Atomic size_t ogon;
+    _Atomic size_t zywe_bajty;
+    void *elementy[ROZMIAR_KOLEJKI];
+    size_t rozmiary[ROZMIAR_KOLEJKI];
+};
+struct konsument_t {
+    const struct alokator_t *alokator;
+    struct kolejka_t *kolejka;
+    struct pomiar_t *pomiar;
+    size_t elementy;
+};
+static void *konsument(void *argument) {
+    // Drugi wątek zwalnia bloki w kolejności ich przydzielenia
+    struct konsument_t *dane = argument;
+    struct kolejka_t *kolejka = dane->kolejka;
+    for (size_t i = 0; i < dane->elementy; i++) {
+        size_t glowa = atomic_load_explicit(&kolejka->glowa, memory_order_relaxed);
+        while (atomic_load_explicit(&kolejka->ogon, memory_order_acquire) == glowa) {
+            sched_yield();
+        }
+        size_t miejsce = glowa % ROZMIAR_KOLEJKI;
+        pomiar_zwolnij(dane->alokator, dane->pomiar, kolejka->elementy[miejsce], kolejka->rozmiary[miejsce]);
+        atomic_fetch_sub_explicit(&kolejka->zywe_bajty, kolejka->rozmiary[miejsce], memory_order_relaxed);
+        atomic_store_explicit(&kolejka->glowa, glowa + 1, memory_order_release);
+    }
+    return NULL;
+}
+static void obciazenie_producent_konsument(const struct alokator_t *alokator, struct pomiar_t *pomiar, size_t bloki) {
+    (void) bloki;
+    struct kolejka_t *kolejka = tablica(sizeof(struct kolejka_t));
+    size_t elementy = pomiar->pojemnosc / 2;
+    uint64_t stan = 0x853c49e6748fea9bull;
+
+    // Konsument zapisuje czasy w drugiej połowie tablicy; żywe bajty obu wątków liczy kolejka
+    struct pomiar_t pomiar_konsumenta = {.czasy = pomiar->czasy + elementy, .pojemnosc = elementy, .bez_zywych = 1};
+    struct konsument_t dane = {alokator, kolejka, &pomiar_konsumenta, elementy};
+    pthread_t watek;
+    int osobny_watek = alokator->wielowatkowy;
+    if (osobny_watek) {
+        pthread_create(&watek, NULL, konsument, &dane);
+    }
+
+    pomiar->pojemnosc = elementy;
+    for (size_t i = 0; i < elementy; i++) {
+        size_t ogon = atomic_load_explicit(&kolejka->ogon, memory_order_relaxed);
+        while (ogon - atomic_load_explicit(&kolejka->glowa, memory_order_acquire) == ROZMIAR_KOLEJKI) {
+            if (!osobny_watek) {
+                // Alokator bez blokady - konsument opróżnia kolejkę w tym samym wątku
+                dane.elementy = ROZMIAR_KOLEJKI;
+                konsument(&dane);
+            } else {
+                sched_yield();
+            }
+        }
+        size_t miejsce = ogon % ROZMIAR_KOLEJKI;
+        kolejka->rozmiary[miejsce] = losowy_rozmiar(&stan) % 1024 + 16;
+        pomiar->zywe_bajty = atomic_fetch_add_explicit(&kolejka->zywe_bajty, kolejka->rozmiary[miejsce],
+                                                       memory_order_relaxed);
+        kolejka->elementy[miejsce] = pomiar_przydziel(alokator, pomiar, kolejka->rozmiary[miejsce]);
+        atomic_store_explicit(&kolejka->ogon, ogon + 1, memory_order_release);
+    }
+
+    if (osobny_watek) {
+        pthread_join(watek, NULL);
+    } else {
+        dane.elementy = elementy - pomiar_konsumenta.operacje;
+        konsument(&dane);
+    }
+    pomiar->operacje += pomiar_konsumenta.operacje;
+    if (pomiar_konsumenta.szczyt_zajetosci > pomiar->szczyt_zajetosci) {
+        pomiar->szczyt_zajetosci = pomiar_konsumenta.szczyt_zajetosci;
+    }
+    pomiar->pojemnosc = 2 * elementy;
+}
+
+static void obciazenie_wzrost_realloc(const struct alokator_t *alokator, struct pomiar_t *pomiar, size_t bloki) {
+    // Bufory rosnące kawałkami jak przy dopisywaniu; po osiągnięciu 64 KiB bufor jest zwalniany i zaczyna od nowa
+    void **wskazniki = tablica(bloki * sizeof(void *));
+    size_t *rozmiary = tablica(bloki * sizeof(size_t));
+    uint64_t stan = 0xda942042e4dd58b5ull;
+    size_t operacje = pomiar->pojemnosc;
+
+    for (size_t i = 0; i < operacje; i++) {
+        size_t miejsce = losowa(&stan) % bloki;
+        if (rozmiary[miejsce] >= 64 * 1024) {
+            pomiar_zwolnij(alokator, pomiar, wskazniki[miejsce], rozmiary[miejsce]);
+            wskazniki[miejsce] = NULL;
+            rozmiary[miejsce] = 0;
+            continue;
+        }
+        size_t rozmiar = rozmiary[miejsce] + 1 + losowa(&stan) % 512;
+        void *nowy = pomiar_zmien_rozmiar(alokator, pomiar, wskazniki[miejsce], rozmiary[miejsce], rozmiar);
+        if (nowy != NULL) {
+            uzyj((char *) nowy + rozmiary[miejsce], rozmiar - rozmiary[miejsce]);
+            wskazniki[miejsce] = nowy;
+            rozmiary[miejsce] = rozmiar;
+        }
+    }
+    for (size_t i = 0; i < bloki; i++) {
+        alokator->zwolnij(wskazniki[i]);
+    }
+}
+
+static void obciazenie_duzy_zbior(const struct alokator_t *alokator, struct pomiar_t *pomiar, size_t bloki) {
+    // Wypełnienie zbioru żywych bloków, wymiany losowych bloków i zwolnienie wszystkiego w losowej kolejności
+    void **wskazniki = tablica(bloki * sizeof(void *));
+    size_t *rozmiary = tablica(bloki * sizeof(size_t));
+    uint64_t stan = 0x2545f4914f6cdd1dull;
+
+    for (size_t i = 0; i < bloki; i++) {
+        rozmiary[i] = 16 + losowa(&stan) % 1009;
+        wskazniki[i] = pomiar_przydziel(alokator, pomiar, rozmiary[i]);
+    }
+    for (size_t i = 0; i < bloki; i++) {
+        size_t miejsce = losowa(&stan) % bloki;
+        pomiar_zwolnij(alokator, pomiar, wskazniki[miejsce], rozmiary[miejsce]);
+        rozmiary[miejsce] = 16 + losowa(&stan) % 1009;
+        wskazniki[miejsce] = pomiar_przydziel(alokator, pomiar, rozmiary[miejsce]);
+    }
+    for (size_t i = bloki; i > 1; i--) {
+        size_t j = losowa(&stan) % i;
+        void *wskaznik = wskazniki[i - 1];
+        size_t rozmiar = rozmiary[i - 1];
+        wskazniki[i - 1] = wskazniki[j];
+        rozmiary[i - 1] = rozmiary[j];
+        wskazniki[j] = wskaznik;
+        rozmiary[j] = rozmiar;
+    }
+    for (size_t i = 0; i < bloki; i++) {
+        pomiar_zwolnij(alokator, pomiar, wskazniki[i], rozmiary[i]);
+    }
+}
+
+static const struct obciazenie_t obciazenia[] = {
+        {"losowe", obciazenie_losowe, 10000, 2000000},
+        {"producent-konsument", obciazenie_producent_konsument, ROZMIAR_KOLEJKI, 2000000},
+        {"wzrost-realloc", obciazenie_wzrost_realloc, 1000, 2000000},
+        {"duzy-zbior", obciazenie_duzy_zbior, 10000, 50000},
+        {"duzy-zbior", obciazenie_duzy_zbior, 100000, 500000},
+        {"duzy-zbior", obciazenie_duzy_zbior, 1000000, 5000000}
+};
+
+// Polityka rozmieszczenia sterty wybrana argumentem (domyślnie HEAP_PLACEMENT z czasu kompilacji)
+static const char *const polityki[] = {"good-fit", "first-fit", "next-fit", "best-fit"};
+static int polityka = -1;
+
+static int porownaj_czasy(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+static uint32_t percentyl(const uint32_t *czasy, size_t ile, double procent) {
+    size_t pozycja = (size_t) (procent / 100.0 * (double) (ile - 1));
+    return czasy[pozycja];
+}
+
+static void uruchom(const struct obciazenie_t *obciazenie, const struct alokator_t *alokator) {
+    struct pomiar_t pomiar = {.czasy = tablica(obciazenie->operacje * sizeof(uint32_t)),
+                              .pojemnosc = obciazenie->operacje};
+    if (alokator->przydziel == heap_malloc) {
+        if (heap_setup() != 0) {
+            fprintf(stderr, "heap_setup nie powiodło się\n");
+            exit(1);
+        }
+        // Pomiar dotyczy samego alokatora - walidacja wewnątrz operacji jest wyłączona, a slaby włączone
+        heap_configure(heap_option_validation, heap_validation_off);
+        heap_configure(heap_option_slabs, 1);
+        if (polityka >= 0) {
+            heap_configure(heap_option_placement, (size_t) polityka);
+        }
+    }
+
+    uint64_t poczatek = teraz();
+    obciazenie->wykonaj(alokator, &pomiar, obciazenie->bloki);
+    double sekundy = (double) (teraz() - poczatek) / 1e9;
+
+    // Szczytowe zużycie pamięci dotyczy tylko tego procesu - każde uruchomienie ma własny proces potomny
+    struct rusage zuzycie;
+    getrusage(RUSAGE_SELF, &zuzycie);
+    size_t probki = pomiar.operacje < pomiar.pojemnosc ? pomiar.operacje : pomiar.pojemnosc;
+    qsort(pomiar.czasy, probki, sizeof(uint32_t), porownaj_czasy);
+
+    char fragmentacja[16] = "-";
+    if (pomiar.szczyt_zajetosci != 0 && pomiar.szczyt_zywych != 0) {
+        snprintf(fragmentacja, sizeof(fragmentacja), "%.2f", (double) pomiar.szczyt_zajetosci / (double) pomiar.szczyt_zywych);
+    }
+    printf("%-20s %-5s %8zu %12.0f %7u %7u %7u %8u %10u %10.1f %8s\n", obciazenie->nazwa, alokator->nazwa,
+           obciazenie->bloki, (double) pomiar.operacje / sekundy, percentyl(pomiar.czasy, probki, 50),
+           percentyl(pomiar.czasy, probki, 90), percentyl(pomiar.czasy, probki, 99),
+           percentyl(pomiar.czasy, probki, 99.9), pomiar.czasy[probki - 1],
+           (double) zuzycie.ru_maxrss / 1024.0, fragmentacja);
+    fflush(stdout);
+
+    if (alokator->przydziel == heap_malloc) {
+        heap_clean();
+    }
+}
+
+int main(int argc, char **argv) {
+    // Opcjonalne argumenty: fragment nazwy wybranych obciążeń i polityka rozmieszczenia sterty
+    const char *filtr = argc > 1 ? argv[1] : "";
+    if (argc > 2) {
+        for (size_t i = 0; i < sizeof(polityki) / sizeof(polityki[0]); i++) {
+            if (strcmp(argv[2], polityki[i]) == 0) {
+                polityka = (int) i;
+            }
+        }
+        if (polityka < 0) {
+            fprintf(stderr, "nieznana polityka %s (good-fit, first-fit, next-fit, best-fit)\n", argv[2]);
+            return 2;
+        }
+    }
+
+    printf("%-20s %-5s %8s %12s %7s %7s %7s %8s %10s %10s %8s\n", "obciazenie", "alok", "bloki", "ops/s",
+           "p50[ns]", "p90", "p99", "p99.9", "max", "RSS[MiB]", "frag");
+    fflush(stdout);
+    for (size_t i = 0; i < sizeof(obciazenia) / sizeof(obciazenia[0]); i++) {
+        if (strstr(obciazenia[i].nazwa, filtr) == NULL) {
+            continue;
+        }
+        for (size_t j = 0; j < sizeof(alokatory) / sizeof(alokatory[0]); j++) {
+            // Każde uruchomienie w osobnym procesie - świeży stan alokatora i niezależny pomiar RSS
+            pid_t potomny = fork();
+            if (potomny == 0) {
+                uruchom(&obciazenia[i], &alokatory[j]);
+                _exit(0);
+            }
+            int status;
+            waitpid(potomny, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                printf("%-20s %-5s przerwane\n", obciazenia[i].nazwa, alokatory[j].nazwa);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include "custom_unistd.h"
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+static char *poczatek_obszaru;
+static size_t granica;
+
+void *custom_sbrk(intptr_t delta) {
+    // Cały obszar rezerwowany jest przy pierwszym wywołaniu - strony dostają pamięć dopiero przy pierwszym zapisie
+    if (poczatek_obszaru == NULL) {
+        void *obszar = mmap(NULL, (size_t) CUSTOM_SBRK_RESERVE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (obszar == MAP_FAILED) {
+            return (void *) -1;
+        }
+        poczatek_obszaru = (char *) obszar;
+    }
+
+    // Jak sbrk: granica nie może wyjść poza zarezerwowany obszar ani cofnąć się przed jego początek
+    if ((delta < 0 && (size_t) -delta > granica) ||
+        (delta > 0 && (size_t) delta > (size_t) CUSTOM_SBRK_RESERVE - granica)) {
+        return (void *) -1;
+    }
+    char *poprzednia_granica = poczatek_obszaru + granica;
+    granica += (size_t) delta;
+
+    // Oddane całe strony wracają do systemu, więc zmniejszenie sterty widać w zużyciu pamięci procesu
+    if (delta < 0) {
+        uintptr_t poczatek_stron = ((uintptr_t) (poczatek_obszaru + granica) + 4095) & ~(uintptr_t) 4095;
+        uintptr_t koniec_stron = ((uintptr_t) poprzednia_granica + 4095) & ~(uintptr_t) 4095;
+        if (poczatek_stron < koniec_stron) {
+            madvise((void *) poczatek_stron, koniec_stron - poczatek_stron, MADV_DONTNEED);
+        }
+    }
+    return poprzednia_granica;
+}
@@ -0,0 +1,14 @@
+#ifndef BADAQU_CUSTOM_UNISTD_H
+#define BADAQU_CUSTOM_UNISTD_H
+
+#include <stdint.h>
+
+// Zastępcza implementacja custom_sbrk dla budowania poza środowiskiem zajęć:
+// przesuwa granicę wewnątrz jednego zarezerwowanego odwzorowania o stałej wielkości
+#ifndef CUSTOM_SBRK_RESERVE
+#define CUSTOM_SBRK_RESERVE ((uint64_t) 4 << 30)
+#endif
+
+void *custom_sbrk(intptr_t delta);
+
+#endif //BADAQU_CUSTOM_UNISTD_H
@@ -1,234 +1,980 @@
+// mremap jest rozszerzeniem GNU - bez niego powiększenie bloku mapowanego odbywa się przez kopiowanie
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include "heap.h"
 
 #define WIELKOSC_CHUNK sizeof(struct memory_chunk_t)
-struct memory_manager_t memory_manager;
+// Wolny blok mieści powiązania kosza i stopkę z wielkością, zaokrąglone do wyrównania bloków
+#define MINIMALNY_OBSZAR ((sizeof(struct wolny_kawalek_t) + sizeof(size_t) + WYROWNANIE - 1) & ~(size_t) (WYROWNANIE - 1))
+// Przedni płotek wypełnia miejsce między nagłówkiem a wyrównanymi danymi (co najmniej 4 bajty)
+#define PLOTEK_PRZED (((WIELKOSC_CHUNK + 4 + WYROWNANIE - 1) & ~(size_t) (WYROWNANIE - 1)) - WIELKOSC_CHUNK)
+#define PLOTEK_ZA 4
+#define POCZATEK_DANYCH (WIELKOSC_CHUNK + PLOTEK_PRZED)
+// Dane slabu dobrane tak, by cały blok płytowy zajmował dokładnie ROZMIAR_SLABU - kolejne slaby leżą ciasno
+#define ROZMIAR_DANYCH_SLABU (ROZMIAR_SLABU - POCZATEK_DANYCH - PLOTEK_ZA)
+struct memory_manager_t glowna_sterta;
+_Thread_local struct memory_manager_t *biezaca_sterta = &glowna_sterta;
+// Granica czystej pamięci sterty głównej - od tego adresu nic nie zostało zapisane (poza stopką wolnego bloku
+// kończącego stertę), więc pamięć jest wyzerowana; przetrwa heap_clean
+static char *czysta_pamiec_od;
+
+#ifdef HEAP_THREAD_SAFE
+// Blokada rekurencyjna - funkcje publiczne wywołują się nawzajem (np. realloc -> malloc)
+#define ZABLOKUJ_STERTE() pthread_mutex_lock(&memory_manager.blokada)
+#define ODBLOKUJ_STERTE() pthread_mutex_unlock(&memory_manager.blokada)
+
+static void blokada_inicjalizuj(void) {
+    pthread_mutexattr_t atrybuty;
+    pthread_mutexattr_init(&atrybuty);
+    pthread_mutexattr_settype(&atrybuty, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&memory_manager.blokada, &atrybuty);
+    pthread_mutexattr_destroy(&atrybuty);
+    memory_manager.blokada_gotowa = 1;
+}
+static void blokada_zniszcz(void) {
+    // Pierwsze heap_setup zastaje wyzerowany menedżer - niszczona jest tylko blokada utworzona wcześniej
+    if (memory_manager.blokada_gotowa) {
+        pthread_mutex_destroy(&memory_manager.blokada);
+        memory_manager.blokada_gotowa = 0;
+    }
+}
+#else
+#define ZABLOKUJ_STERTE() ((void) 0)
+#define ODBLOKUJ_STERTE() ((void) 0)
+#endif
+
+#ifdef HEAP_STATS_LATENCY
+// Czas operacji publicznej trafia do histogramu wskazanego w memory_manager.statystyki
+#define POMIAR_START() uint64_t poczatek_pomiaru = statystyki_czas()
+#define POMIAR_KONIEC(histogram) \
+    statystyki_zapisz_czas(memory_manager.statystyki.histogram, statystyki_czas() - poczatek_pomiaru)
+#else
+#define POMIAR_START() ((void) 0)
+#define POMIAR_KONIEC(histogram) ((void) 0)
+#endif
 
 int heap_setup(void) {
-    // Pobranie początkowego adresu sterty i inicjalizacja menedżera pamięci
-    memory_manager.poczatek = custom_sbrk(0);
-    memory_manager.pierwszy_kawalek = NULL;
-    memory_manager.wielkosc_pamieci = 0;
+    // Pobranie początkowego adresu sterty i inicjalizacja menedżera pamięci (wraz z pustymi koszami);
+    // obszar sterty utworzonej przez heap_create pozostaje przy niej. Żaden inny wątek nie może w tym czasie
+    // korzystać ze sterty - jej blokada jest niszczona i tworzona od nowa, a pamięci wątków czyszczone
+#ifdef HEAP_THREAD_SAFE
+    blokada_zniszcz();
+    if (biezaca_sterta == &glowna_sterta) {
+        pamiec_watku_wyczysc_wszystkie();
+    }
+#endif
+    struct obszar_sterty_t obszar = memory_manager.obszar;
+    memory_manager = (struct memory_manager_t) {
+            .obszar = obszar,
+            .wielkosc_pamieci = 0,
+            .tryb_walidacji = HEAP_VALIDATION,
+            .okres_walidacji = HEAP_VALIDATION_PERIOD,
+            .slaby_wlaczone = HEAP_SLABS,
+            .prog_mmap = obszar.plik ? 0 : HEAP_MMAP_THRESHOLD,
+            .prog_przycinania = HEAP_TRIM_THRESHOLD,
+            .przyrost_min = HEAP_GROWTH_MIN,
+            .przyrost_max = HEAP_GROWTH_MAX,
+            .przyrost = HEAP_GROWTH_MIN,
+            .polityka_rozmieszczenia = HEAP_PLACEMENT
+    };
+    memory_manager.poczatek = sterta_sbrk(0);
+
+    // Granica czystej pamięci przetrwa heap_clean - pamięć poprzedniej sterty pozostaje brudna
+    char **czyste_od = sterta_czysta_pamiec();
+    if ((char *) memory_manager.poczatek > *czyste_od) {
+        *czyste_od = memory_manager.poczatek;
+    }
+#ifdef HEAP_THREAD_SAFE
+    blokada_inicjalizuj();
+#endif
 
     // Sprawdzenie, czy inicjalizacja się powiodła
     if (memory_manager.poczatek == (void *) -1) {
         return -1;
     }
 
+    // Bloki zaczynają się od adresów wyrównanych do WYROWNANIE - ewentualne wyrównanie początku należy do sterty
+    size_t wyrownanie = (size_t) (-(uintptr_t) memory_manager.poczatek & (WYROWNANIE - 1));
+    if (wyrownanie != 0) {
+        if (wywolaj_sbrk((intptr_t) wyrownanie) == (void *) -1) {
+            return -1;
+        }
+        memory_manager.wielkosc_pamieci = wyrownanie;
+    }
+
+    // Indeks adresów jest opcjonalny - bez niego bloki odnajduje przejście listy
+    indeks_utworz();
     return 0;
 }
 
 void heap_clean(void) {
+    // Bloki mapowane nie należą do sterty - każdy zwalniany jest osobno
+    struct memory_chunk_t *duzy_blok = memory_manager.duze_bloki;
+    while (duzy_blok != NULL) {
+        struct memory_chunk_t *nastepny = KAWALEK_NASTEPNY(duzy_blok);
+        munmap((char *) duzy_blok - PRZEDROSTEK_MMAP, mmap_rozmiar_mapowania(duzy_blok->wielkosc));
+        duzy_blok = nastepny;
+    }
+
+    indeks_zwolnij();
+
     // Sprawdzenie, czy istnieje zaalokowana pamięć do zwolnienia
     if (memory_manager.wielkosc_pamieci > 0) {
-        custom_sbrk(-(intptr_t) memory_manager.wielkosc_pamieci);
+        wywolaj_sbrk(-(intptr_t) memory_manager.wielkosc_pamieci);
     }
 
-    // Resetowanie menedżera pamięci do stanu początkowego
-    memory_manager.poczatek = NULL;
-    memory_manager.pierwszy_kawalek = NULL;
-    memory_manager.wielkosc_pamieci = 0;
+    // Resetowanie menedżera pamięci do stanu początkowego (pamięci wątków należą do sterty głównej); blokada
+    // i pamięci wątków są czyszczone bez synchronizacji, więc inne wątki muszą wcześniej przestać korzystać ze sterty
+#ifdef HEAP_THREAD_SAFE
+    blokada_zniszcz();
+    if (biezaca_sterta == &glowna_sterta) {
+        pamiec_watku_wyczysc_wszystkie();
+    }
+#endif
+    struct obszar_sterty_t obszar = memory_manager.obszar;
+    memory_manager = (struct memory_manager_t) {.obszar = obszar, .poczatek = NULL};
+#ifdef HEAP_THREAD_SAFE
+    blokada_inicjalizuj();
+#endif
 }
 
-void *heap_malloc(size_t rozmiar) {
-    // Sprawdzenie, czy rozmiar jest równy 0 lub czy start pamięci nie jest zainicjalizowany
-    if (rozmiar == 0 || memory_manager.poczatek == NULL) {
+heap_t *heap_create(size_t capacity) {
+    // Menedżer i obszar nowej sterty pochodzą z mmap - sterta nie korzysta z custom_sbrk ani ze sterty głównej
+    size_t pojemnosc = capacity != 0 ? capacity : HEAP_DEFAULT_CAPACITY;
+    pojemnosc = (pojemnosc + ROZMIAR_STRONY - 1) & ~(size_t) (ROZMIAR_STRONY - 1);
+    heap_t *sterta = mmap(NULL, sizeof(heap_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (sterta == MAP_FAILED) {
+        return NULL;
+    }
+    void *obszar = mmap(NULL, pojemnosc, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (obszar == MAP_FAILED) {
+        munmap(sterta, sizeof(heap_t));
+        return NULL;
+    }
+    sterta->obszar = (struct obszar_sterty_t) {.poczatek = obszar, .pojemnosc = pojemnosc, .czyste_od = obszar};
+
+    // Nowa sterta przechodzi zwykłą inicjalizację heap_setup jako bieżąca sterta wątku
+    struct memory_manager_t *poprzednia = sterta_wybierz(sterta);
+    int wynik = heap_setup();
+    biezaca_sterta = poprzednia;
+    if (wynik != 0) {
+        munmap(obszar, pojemnosc);
+        munmap(sterta, sizeof(heap_t));
         return NULL;
     }
+    return sterta;
+}
+void heap_destroy(heap_t *heap) {
+    if (heap == NULL || heap == &glowna_sterta) {
+        return;
+    }
 
-    // Pobranie wskaźnika na pierwszy blok pamięci
-    struct memory_chunk_t *aktualny_blok = memory_manager.pierwszy_kawalek;
+    // Sterta z pliku nie jest czyszczona - zostaje zapisana i odłączona, a jej bloki czekają na kolejne heap_open
+    struct memory_manager_t *poprzednia = sterta_wybierz(heap);
+    if (heap->obszar.plik) {
+        heap_sync(heap);
+        indeks_zwolnij();
+    } else {
+        heap_clean();
+    }
+#ifdef HEAP_THREAD_SAFE
+    blokada_zniszcz();
+#endif
+    biezaca_sterta = poprzednia;
 
-    // Jeśli nie ma jeszcze żadnego bloku, alokuj pierwszy blok pamięci
-    if (aktualny_blok == NULL) {
-        return malloc_alokuj_poczatkowy_blok_pamieci(rozmiar);
+    if (heap->obszar.plik) {
+        munmap(heap->obszar.poczatek - NAGLOWEK_PLIKU_STERTY, NAGLOWEK_PLIKU_STERTY + heap->obszar.pojemnosc);
+        return;
+    }
+    munmap(heap->obszar.poczatek, heap->obszar.pojemnosc);
+    munmap(heap, sizeof(heap_t));
+}
+heap_t *heap_open(const char *path, size_t capacity) {
+    // Plik zawiera nagłówek z menedżerem sterty i cały jej obszar - odwzorowanie współdzielone zapisuje zmiany w pliku
+    int plik = open(path, O_RDWR | O_CREAT, 0600);
+    struct stat informacje;
+    if (plik < 0) {
+        return NULL;
+    }
+    if (fstat(plik, &informacje) != 0) {
+        close(plik);
+        return NULL;
     }
 
-    // Walidacja pamięci przed przeszukiwaniem
-    if (heap_validate() != 0) {
+    struct plik_sterty_t naglowek = {0};
+    int nowy = informacje.st_size == 0;
+    if (nowy) {
+        naglowek.pojemnosc = capacity != 0 ? capacity : HEAP_DEFAULT_CAPACITY;
+        naglowek.pojemnosc = (naglowek.pojemnosc + ROZMIAR_STRONY - 1) & ~(size_t) (ROZMIAR_STRONY - 1);
+        if (ftruncate(plik, (off_t) (NAGLOWEK_PLIKU_STERTY + naglowek.pojemnosc)) != 0) {
+            close(plik);
+            return NULL;
+        }
+    } else if (pread(plik, &naglowek, sizeof(naglowek), 0) != (ssize_t) sizeof(naglowek) ||
+               naglowek.magia != MAGIA_PLIKU_STERTY || naglowek.wersja != WERSJA_PLIKU_STERTY ||
+               naglowek.wielkosc_naglowka_bloku != WIELKOSC_CHUNK || naglowek.wielkosc_menedzera != sizeof(heap_t) ||
+               (size_t) informacje.st_size != NAGLOWEK_PLIKU_STERTY + naglowek.pojemnosc) {
+        close(plik);
         return NULL;
     }
 
-    // Szukaj najlepszego dopasowania lub rozszerz pamięć, jeśli to konieczne
-    return malloc_znajdz_najlepsze_dopasowanie_lub_rozszerz_pamiec(rozmiar, aktualny_blok);
+    // Odwzorowanie najpierw pod poprzednim adresem - wtedy wskaźniki menedżera nie wymagają przesunięcia
+    char *podpowiedz = nowy ? NULL : naglowek.sterta.obszar.poczatek - NAGLOWEK_PLIKU_STERTY;
+    char *pamiec = mmap(podpowiedz, NAGLOWEK_PLIKU_STERTY + naglowek.pojemnosc, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_NORESERVE, plik, 0);
+    close(plik);
+    if (pamiec == MAP_FAILED) {
+        return NULL;
+    }
+    struct plik_sterty_t *odwzorowanie = (struct plik_sterty_t *) pamiec;
+    heap_t *sterta = &odwzorowanie->sterta;
+    struct memory_manager_t *poprzednia = sterta_wybierz(sterta);
+    int wynik = 0;
+    if (nowy) {
+        // Nowy plik przechodzi zwykłą inicjalizację heap_setup; nagłówek zapisywany jest dopiero po niej
+        memory_manager.obszar = (struct obszar_sterty_t) {
+                .poczatek = pamiec + NAGLOWEK_PLIKU_STERTY,
+                .pojemnosc = naglowek.pojemnosc,
+                .czyste_od = pamiec + NAGLOWEK_PLIKU_STERTY,
+                .plik = 1
+        };
+        wynik = heap_setup();
+        odwzorowanie->pojemnosc = naglowek.pojemnosc;
+        odwzorowanie->wielkosc_naglowka_bloku = WIELKOSC_CHUNK;
+        odwzorowanie->wielkosc_menedzera = sizeof(heap_t);
+        odwzorowanie->wersja = WERSJA_PLIKU_STERTY;
+        odwzorowanie->magia = MAGIA_PLIKU_STERTY;
+    } else {
+        // Istniejąca sterta jest gotowa od razu - sprawdzenie i indeks adresów czekają na pierwszą operację
+        plik_przenies((intptr_t) ((uintptr_t) pamiec - (uintptr_t) podpowiedz));
+        if (memory_manager.pierwszy_kawalek == NULL) {
+            wynik = plik_dokoncz_otwarcie();
+        }
+#ifdef HEAP_THREAD_SAFE
+        // Obraz blokady w pliku pochodzi z poprzedniego procesu - nie jest niszczony, tylko tworzony od nowa
+        memset(&memory_manager.blokada, 0, sizeof(memory_manager.blokada));
+        blokada_inicjalizuj();
+#endif
+    }
+    biezaca_sterta = poprzednia;
+    if (wynik != 0) {
+        munmap(pamiec, NAGLOWEK_PLIKU_STERTY + naglowek.pojemnosc);
+        return NULL;
+    }
+    return sterta;
 }
-void *malloc_alokuj_poczatkowy_blok_pamieci(size_t rozmiar) {
-    // Rezerwacja miejsca na nowy blok pamięci z dodatkowym miejscem na metadane
-    struct memory_chunk_t *blok = (struct memory_chunk_t *) custom_sbrk((long) (WIELKOSC_CHUNK + rozmiar + 8));
-    if (blok == (void *) -1) {
-        return NULL; // Nie udało się zarezerwować pamięci
+int heap_sync(heap_t *heap) {
+    if (heap == NULL || !heap->obszar.plik) {
+        return -1;
     }
 
-    // Inicjalizacja nowego bloku pamięci
-    *blok = (struct memory_chunk_t) {.poprzedni = NULL, .nastepny = NULL, .wielkosc = rozmiar, .czy_wolny = 0};
+    // Nagłówek z menedżerem i zajęta część obszaru trafiają do pliku w stanie spójnym (pod blokadą sterty)
+    struct memory_manager_t *poprzednia = sterta_wybierz(heap);
+    ZABLOKUJ_STERTE();
+    int wynik = msync(heap->obszar.poczatek - NAGLOWEK_PLIKU_STERTY, NAGLOWEK_PLIKU_STERTY + heap->obszar.granica, MS_SYNC);
+    ODBLOKUJ_STERTE();
+    biezaca_sterta = poprzednia;
+    return wynik == 0 ? 0 : -1;
+}
+int heap_set_root(heap_t *heap, void *root) {
+    // Korzeń sterty z pliku zapisany jest względem początku obszaru, więc przetrwa jej przeniesienie
+    if (heap == NULL || !heap->obszar.plik) {
+        return -1;
+    }
+    struct memory_manager_t *poprzednia = sterta_wybierz(heap);
+    ZABLOKUJ_STERTE();
+    heap->korzen = przesuniecie_wzgledne(heap->obszar.poczatek, root);
+    ODBLOKUJ_STERTE();
+    biezaca_sterta = poprzednia;
+    return 0;
+}
+void *heap_get_root(heap_t *heap) {
+    if (heap == NULL || !heap->obszar.plik) {
+        return NULL;
+    }
+    return adres_wzgledny(heap->obszar.poczatek, heap->korzen);
+}
+int heap_reset(heap_t *heap) {
+    // Wszystkie bloki sterty znikają naraz: heap_clean oddaje całą pamięć, a heap_setup zaczyna od pustej sterty
+    struct memory_manager_t *poprzednia = sterta_wybierz(heap);
+    heap_clean();
+    int wynik = heap_setup();
+    biezaca_sterta = poprzednia;
+    return wynik;
+}
+void *heap_malloc_in(heap_t *heap, size_t size) {
+    struct memory_manager_t *poprzednia = sterta_wybierz(heap);
+    void *wynik = heap_malloc(size);
+    biezaca_sterta = poprzednia;
+    return wynik;
+}
+void *heap_calloc_in(heap_t *heap, size_t number, size_t size) {
+    struct memory_manager_t *poprzednia = sterta_wybierz(heap);
+    void *wynik = heap_calloc(number, size);
+    biezaca_sterta = poprzednia;
+    return wynik;
+}
+void *heap_realloc_in(heap_t *heap, void *memblock, size_t count) {
+    struct memory_manager_t *poprzednia = sterta_wybierz(heap);
+    void *wynik = heap_realloc(memblock, count);
+    biezaca_sterta = poprzednia;
+    return wynik;
+}
+void heap_free_in(heap_t *heap, void *memblock) {
+    struct memory_manager_t *poprzednia = sterta_wybierz(heap);
+    heap_free(memblock);
+    biezaca_sterta = poprzednia;
+}
 
-    // Aktualizacja globalnych informacji o zarządzaniu pamięcią
-    memory_manager.wielkosc_pamieci += WIELKOSC_CHUNK + rozmiar + 8;
-    memory_manager.pierwszy_kawalek = blok;
+void *heap_malloc(size_t rozmiar) {
+    // W trakcie zapisu śladu operacja przechodzi przez funkcję zapisującą zdarzenie
+    if (slad_aktywny()) {
+        return slad_malloc(rozmiar);
+    }
+    POMIAR_START();
+#ifdef HEAP_THREAD_SAFE
+    // Małe bloki wydaje bez blokady pamięć podręczna bieżącego wątku
+    void *z_pamieci_watku = pamiec_watku_przydziel(rozmiar);
+    if (z_pamieci_watku != NULL) {
+        POMIAR_KONIEC(czas_malloc);
+        return z_pamieci_watku;
+    }
+#endif
+    ZABLOKUJ_STERTE();
+    void *wynik = malloc_wykonaj(rozmiar);
+    if (wynik != NULL) {
+        statystyki_przydzial(rozmiar);
+    }
+    ODBLOKUJ_STERTE();
+    POMIAR_KONIEC(czas_malloc);
+    return wynik;
+}
+void *heap_aligned_alloc(size_t alignment, size_t size) {
+    // Wyrównanie musi być potęgą dwójki; do WYROWNANIE spełnia je każdy blok
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    if (slad_aktywny()) {
+        return slad_aligned_alloc(alignment, size);
+    }
+    if (alignment <= WYROWNANIE) {
+        return heap_malloc(size);
+    }
 
-    // Inicjalizacja bloku pamięci i obliczenie jego checksumy
-    malloc_inicjalizuj_blok_pamieci(blok);
-    blok->checksuma = oblicz_checksuma(blok);
+    void *wynik = NULL;
+    ZABLOKUJ_STERTE();
+    if (size != 0 && memory_manager.poczatek != NULL &&
+        (memory_manager.pierwszy_kawalek == NULL || walidacja_globalna() == 0)) {
+        wynik = malloc_przydziel_wyrownany(alignment, size);
+    }
+    if (wynik != NULL) {
+        statystyki_przydzial(size);
+    }
+    ODBLOKUJ_STERTE();
+    return wynik;
+}
+int heap_posix_memalign(void **memptr, size_t alignment, size_t size) {
+    // Jak posix_memalign: wyrównanie musi być niezerową potęgą dwójki i wielokrotnością sizeof(void *)
+    if (memptr == NULL || alignment == 0 || alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
 
-    // Zwrócenie wskaźnika do użytkowej części bloku pamięci
-    return (void *) ((char *) blok + WIELKOSC_CHUNK + 4);
+    void *wynik = heap_aligned_alloc(alignment, size);
+    if (wynik == NULL && size != 0) {
+        return ENOMEM;
+    }
+    *memptr = wynik;
+    return 0;
 }
-void *malloc_znajdz_najlepsze_dopasowanie_lub_rozszerz_pamiec(size_t size, struct memory_chunk_t *blok) {
-    struct memory_chunk_t *najlepsze_dopasowanie = NULL;
-    size_t najlepszy_rozmiar = SIZE_MAX;
+void *malloc_wykonaj(size_t rozmiar) {
+    // Sprawdzenie, czy rozmiar jest równy 0 lub czy start pamięci nie jest zainicjalizowany
+    if (rozmiar == 0 || memory_manager.poczatek == NULL) {
+        return NULL;
+    }
 
-    // Przeszukiwanie listy bloków w poszukiwaniu najlepszego dopasowania
-    for (; blok != NULL; blok = blok->nastepny) {
-        if (blok->czy_wolny && blok->wielkosc >= size + 8 && blok->wielkosc < najlepszy_rozmiar) {
-            najlepsze_dopasowanie = blok;
-            najlepszy_rozmiar = blok->wielkosc;
-        }
+    // Walidacja pamięci przed przeszukiwaniem (zakres zależy od trybu walidacji)
+    if (memory_manager.pierwszy_kawalek != NULL && walidacja_globalna() != 0) {
+        return NULL;
+    }
+
+    return malloc_przydziel(rozmiar);
+}
+void *malloc_przydziel(size_t rozmiar) {
+    // Małe obiekty trafiają do slabów zamiast do osobnych bloków
+    if (memory_manager.slaby_wlaczone && rozmiar <= NAJWIEKSZY_OBIEKT_SLABU) {
+        return slab_przydziel(rozmiar);
+    }
 
-        // Jeśli doszliśmy do końca listy i nie znaleziono dopasowania, rozszerz pamięć
-        if (blok->nastepny == NULL && najlepsze_dopasowanie == NULL) {
-            return malloc_rozszerz_pamiec(size, blok);
+    // Duże bloki dostają własne odwzorowanie, zwracane systemowi przy zwolnieniu
+    if (memory_manager.prog_mmap != 0 && rozmiar >= memory_manager.prog_mmap) {
+        void *zmapowany = mmap_przydziel(rozmiar);
+        if (zmapowany != NULL) {
+            return zmapowany;
         }
     }
 
-    // Jeśli znaleziono najlepsze dopasowanie, zaktualizuj blok i zwróć wskaźnik do użytkowej części
-    if (najlepsze_dopasowanie) {
-        najlepsze_dopasowanie->wielkosc = size;
-        najlepsze_dopasowanie->czy_wolny = 0;
-        malloc_inicjalizuj_blok_pamieci(najlepsze_dopasowanie);
-        najlepsze_dopasowanie->checksuma = oblicz_checksuma(najlepsze_dopasowanie);
-        return (void *) ((char *) najlepsze_dopasowanie + WIELKOSC_CHUNK + 4);
+    return malloc_przydziel_blok(rozmiar);
+}
+int malloc_zwykly_blok(size_t rozmiar) {
+    // Czy żądanie obsłuży osobny blok sterty (a nie slab ani odwzorowanie mmap)
+    return !(memory_manager.slaby_wlaczone && rozmiar <= NAJWIEKSZY_OBIEKT_SLABU) &&
+           !(memory_manager.prog_mmap != 0 && rozmiar >= memory_manager.prog_mmap);
+}
+void *malloc_przydziel_blok(size_t rozmiar) {
+    // Jeśli nie ma jeszcze żadnego bloku, alokuj pierwszy blok pamięci
+    if (memory_manager.pierwszy_kawalek == NULL) {
+        return malloc_alokuj_poczatkowy_blok_pamieci(rozmiar);
     }
 
-    return NULL;
+    // Szukaj najlepszego dopasowania lub rozszerz pamięć, jeśli to konieczne
+    return malloc_znajdz_dopasowanie_lub_rozszerz_pamiec(rozmiar);
 }
-void malloc_inicjalizuj_nowy_blok(struct memory_chunk_t *blok, struct memory_chunk_t *nowy_blok, size_t rozmiar) {
-    // Ustawienie wskaźników i wartości dla nowego bloku
-    *nowy_blok = (struct memory_chunk_t) {
-            .poprzedni = blok,
-            .nastepny = NULL,
-            .wielkosc = rozmiar,
-            .czy_wolny = 0
-    };
+size_t malloc_wymagany_obszar(size_t rozmiar) {
+    // Dane wraz z płotkami, zaokrąglone tak, by następny blok też był wyrównany
+    size_t obszar = (PLOTEK_PRZED + rozmiar + PLOTEK_ZA + WYROWNANIE - 1) & ~(size_t) (WYROWNANIE - 1);
+    return obszar < MINIMALNY_OBSZAR ? MINIMALNY_OBSZAR : obszar;
+}
+void *malloc_alokuj_poczatkowy_blok_pamieci(size_t rozmiar) {
+    // Pierwszy blok powstaje tak jak każde rozszerzenie sterty - z wolnego bloku na jej końcu
+    return malloc_rozszerz_pamiec(rozmiar);
+}
+void *malloc_znajdz_dopasowanie_lub_rozszerz_pamiec(size_t size) {
+    // Wolny blok wybiera bieżąca polityka rozmieszczenia
+    struct memory_chunk_t *dopasowanie = rozmieszczenie_znajdz(malloc_wymagany_obszar(size));
+
+    // Jeśli żaden wolny blok nie wystarcza, rozszerz pamięć za ostatnim blokiem
+    if (dopasowanie == NULL) {
+        if (walidacja_lokalna(memory_manager.ostatni_kawalek) != 0) {
+            return NULL;
+        }
+        return malloc_rozszerz_pamiec(size);
+    }
+    if (walidacja_lokalna(dopasowanie) != 0) {
+        return NULL;
+    }
+    return malloc_przydziel_z_kosza(dopasowanie, size);
+}
+void *malloc_przydziel_z_kosza(struct memory_chunk_t *blok, size_t rozmiar) {
+    kosze_usun(blok);
+    return malloc_zajmij_blok(blok, rozmiar);
+}
+void *malloc_zajmij_blok(struct memory_chunk_t *blok, size_t rozmiar) {
+    // Zaktualizuj wolny blok spoza koszy; nadmiar ponad potrzebny obszar wraca do koszy jako osobny wolny blok
+    blok->czy_wolny = 0;
+    struct memory_chunk_t *reszta = podziel_blok(blok, malloc_wymagany_obszar(rozmiar));
+    if (reszta != NULL) {
+        free_zwolnij_blok(reszta);
+    }
+    blok->wielkosc = rozmiar;
+    calloc_oznacz_wydany(blok);
+    malloc_inicjalizuj_blok_pamieci(blok);
+    blok->checksuma = oblicz_checksuma(blok);
+    return (void *) ((char *) blok + POCZATEK_DANYCH);
+}
+void *malloc_rozszerz_pamiec(size_t size) {
+    // Sterta rośnie o cały przyrost, a blok odcinany jest od początku wolnego bloku na jej końcu
+    struct memory_chunk_t *blok = malloc_rozszerz_o_wolny_blok(malloc_wymagany_obszar(size));
+    if (blok == NULL) {
+        return NULL; // Nie udało się zarezerwować pamięci
+    }
+    return malloc_zajmij_blok(blok, size);
+}
+struct memory_chunk_t *malloc_rozszerz_o_wolny_blok(size_t obszar) {
+    struct memory_chunk_t *ostatni = memory_manager.ostatni_kawalek;
+
+    // Wolny ostatni blok powiększamy co najmniej do żądanego obszaru (kosz wynika z rozmiaru, więc opuszcza go przed zmianą)
+    if (ostatni != NULL && ostatni->czy_wolny) {
+        kosze_usun(ostatni);
+        if (ostatni->wielkosc < obszar) {
+            size_t dopisane = wzrost_rozszerz(obszar - ostatni->wielkosc);
+            if (dopisane == 0) {
+                kosze_wstaw(ostatni);
+                return NULL;
+            }
+            // Dotychczasowa stopka trafia do wnętrza bloku - pamięć za nią pozostaje czysta
+            *znacznik_stopka(ostatni) = 0;
+            ostatni->wielkosc += dopisane;
+        }
+        ostatni->checksuma = oblicz_checksuma(ostatni);
+        return ostatni;
+    }
 
-    // Aktualizacja wskaźnika next poprzedniego bloku
-    blok->nastepny = nowy_blok;
+    // W przeciwnym razie nowy wolny blok (poza koszami) na końcu sterty, obejmujący cały przyrost
+    struct memory_chunk_t *nowy_blok = (struct memory_chunk_t *) ((char *) memory_manager.poczatek +
+                                                                  memory_manager.wielkosc_pamieci);
+    size_t dopisane = wzrost_rozszerz(WIELKOSC_CHUNK + obszar);
+    if (dopisane == 0) {
+        return NULL;
+    }
+    *nowy_blok = (struct memory_chunk_t) {.wielkosc = dopisane - WIELKOSC_CHUNK, .czy_wolny = 1};
+    KAWALEK_USTAW_POPRZEDNI(nowy_blok, ostatni);
+    calloc_oznacz_zapisane((char *) nowy_blok + POCZATEK_DANYCH);
 
-    // Inicjalizacja bloku pamięci i obliczenie metadanych
-    malloc_inicjalizuj_blok_pamieci(nowy_blok);
-    blok->checksuma = oblicz_checksuma(blok);
+    if (ostatni != NULL) {
+        KAWALEK_USTAW_NASTEPNY(ostatni, nowy_blok);
+        ostatni->checksuma = oblicz_checksuma(ostatni);
+    } else {
+        memory_manager.pierwszy_kawalek = nowy_blok;
+    }
+    memory_manager.ostatni_kawalek = nowy_blok;
+    indeks_dodaj(nowy_blok);
     nowy_blok->checksuma = oblicz_checksuma(nowy_blok);
+    return nowy_blok;
 }
-void *malloc_rozszerz_pamiec(size_t size, struct memory_chunk_t *blok) {
-    // Oblicz potrzebny rozmiar pamięci, uwzględniając dodatkowe bajty na zarządzanie
-    size_t calkowity_rozmiar = WIELKOSC_CHUNK + 8 + size;
+void *malloc_przydziel_wyrownany(size_t wyrownanie, size_t rozmiar) {
+    // Zapas pozwala przesunąć dane do wyrównanego adresu i oddzielić przed nimi wolny blok
+    size_t potrzeba = malloc_wymagany_obszar(rozmiar);
+    size_t zapas = wyrownanie + WIELKOSC_CHUNK + MINIMALNY_OBSZAR;
+
+    struct memory_chunk_t *blok = rozmieszczenie_znajdz(potrzeba + zapas);
+    if (blok != NULL) {
+        kosze_usun(blok);
+    } else {
+        // Na końcu sterty wystarczy dokładnie tyle pamięci, ile wymaga wyrównanie od miejsca nowego bloku
+        struct memory_chunk_t *ostatni = memory_manager.ostatni_kawalek;
+        char *miejsce = ostatni != NULL && ostatni->czy_wolny
+                        ? (char *) ostatni : (char *) memory_manager.poczatek + memory_manager.wielkosc_pamieci;
+        blok = malloc_rozszerz_o_wolny_blok(malloc_przesuniecie_wyrownania(miejsce, wyrownanie) + potrzeba);
+        if (blok == NULL) {
+            return NULL;
+        }
+    }
 
-    // Próba alokacji nowego bloku pamięci
-    struct memory_chunk_t *nowy_blok = (struct memory_chunk_t *) custom_sbrk((intptr_t) calkowity_rozmiar);
+    size_t przesuniecie = malloc_przesuniecie_wyrownania((char *) blok, wyrownanie);
+    if (przesuniecie != 0) {
+        // Część przed wyrównanym adresem pozostaje wolnym blokiem
+        struct memory_chunk_t *wyrownany_blok = podziel_blok(blok, przesuniecie - WIELKOSC_CHUNK);
+        kosze_wstaw(blok);
+        blok->checksuma = oblicz_checksuma(blok);
+        blok = wyrownany_blok;
+    }
 
-    // Sprawdzenie, czy alokacja się powiodła
-    if (nowy_blok == (void *) -1) {
-        return NULL; // Nie udało się zaalokować pamięci
+    // Nadmiar za danymi wraca na stertę jako wolny blok (blok jest już zajęty, więc nie zostanie z nim scalony)
+    blok->czy_wolny = 0;
+    struct memory_chunk_t *reszta = podziel_blok(blok, potrzeba);
+    if (reszta != NULL) {
+        free_zwolnij_blok(reszta);
     }
 
-    // Aktualizacja całkowitego rozmiaru zarządzanej pamięci
-    memory_manager.wielkosc_pamieci += calkowity_rozmiar;
+    blok->wielkosc = rozmiar;
+    calloc_oznacz_wydany(blok);
+    malloc_inicjalizuj_blok_pamieci(blok);
+    blok->checksuma = oblicz_checksuma(blok);
+    return (void *) ((char *) blok + POCZATEK_DANYCH);
+}
+size_t malloc_przesuniecie_wyrownania(char *miejsce_bloku, size_t wyrownanie) {
+    // Odległość od danych bloku do pierwszego wyrównanego adresu, przed którym zmieści się samodzielny wolny blok
+    uintptr_t dane = (uintptr_t) miejsce_bloku + POCZATEK_DANYCH;
+    size_t przesuniecie = (size_t) (((dane + wyrownanie - 1) & ~(uintptr_t) (wyrownanie - 1)) - dane);
+    while (przesuniecie != 0 && przesuniecie < WIELKOSC_CHUNK + MINIMALNY_OBSZAR) {
+        przesuniecie += wyrownanie;
+    }
+    return przesuniecie;
+}
+struct memory_chunk_t *podziel_blok(struct memory_chunk_t *blok, size_t obszar) {
+    // Reszta musi pomieścić własny nagłówek i powiązania wolnego bloku
+    size_t dostepny_obszar = obszar_bloku(blok);
+    if (dostepny_obszar < obszar + WIELKOSC_CHUNK + MINIMALNY_OBSZAR) {
+        return NULL;
+    }
 
-    // Inicjalizacja nowego bloku pamięci
-    malloc_inicjalizuj_nowy_blok(blok, nowy_blok, size);
+    // Nowy blok zaczyna się zaraz za pierwszymi 'obszar' bajtami danych bloku
+    struct memory_chunk_t *reszta = (struct memory_chunk_t *) ((char *) blok + WIELKOSC_CHUNK + obszar);
+    *reszta = (struct memory_chunk_t) {
+            .wielkosc = dostepny_obszar - obszar - WIELKOSC_CHUNK,
+            .czy_wolny = 1
+    };
+    KAWALEK_USTAW_POPRZEDNI(reszta, blok);
+    KAWALEK_USTAW_NASTEPNY(reszta, KAWALEK_NASTEPNY(blok));
+    calloc_oznacz_zapisane((char *) reszta + POCZATEK_DANYCH);
 
-    // Zwrócenie wskaźnika do użytkowej części pamięci, przesuniętego o odpowiedni offset
-    return (void *) ((char *) nowy_blok + WIELKOSC_CHUNK + 4);
+    if (KAWALEK_NASTEPNY(reszta)) {
+        KAWALEK_USTAW_POPRZEDNI(KAWALEK_NASTEPNY(reszta), reszta);
+        KAWALEK_NASTEPNY(reszta)->checksuma = oblicz_checksuma(KAWALEK_NASTEPNY(reszta));
+    } else {
+        memory_manager.ostatni_kawalek = reszta;
+    }
+    KAWALEK_USTAW_NASTEPNY(blok, reszta);
+    indeks_dodaj(reszta);
+    if (blok->czy_wolny) {
+        blok->wielkosc = obszar;
+    }
+    blok->checksuma = oblicz_checksuma(blok);
+    reszta->checksuma = oblicz_checksuma(reszta);
+    return reszta;
 }
 void malloc_inicjalizuj_blok_pamieci(struct memory_chunk_t *blok) {
     // Ustawienie wskaźnika na koniec bloku danych
-    char *koniec_danych = (char *) blok + WIELKOSC_CHUNK + 4 + blok->wielkosc;
+    char *koniec_danych = (char *) blok + POCZATEK_DANYCH + blok->wielkosc;
     // Ręczne wypełnienie końcowego obszaru znakami '#'
-    for (int i = 0; i < 4; i++) {
+    for (size_t i = 0; i < PLOTEK_ZA; i++) {
         koniec_danych[i] = '#';
     }
 
     // Ustawienie wskaźnika na początek danych
     char *poczatek_danych = (char *) blok + WIELKOSC_CHUNK;
-    // Ręczne wypełnienie początkowego obszaru znakami '#'
-    for (int i = 0; i < 4; i++) {
+    // Ręczne wypełnienie początkowego obszaru (aż do wyrównanych danych) znakami '#'
+    for (size_t i = 0; i < PLOTEK_PRZED; i++) {
         poczatek_danych[i] = '#';
     }
 }
 
 void *heap_calloc(size_t liczba, size_t ile) {
+    if (slad_aktywny()) {
+        return slad_calloc(liczba, ile);
+    }
     if (liczba == 0 || ile == 0) {
         return NULL;
     }
 
-    size_t wielkosc = liczba * ile;
+    // Iloczyn przekraczający zakres size_t oznacza żądanie niemożliwe do spełnienia
+    size_t wielkosc;
+    if (__builtin_mul_overflow(liczba, ile, &wielkosc)) {
+        return NULL;
+    }
+
+    // Granica czystej pamięci odczytana przed przydziałem - od niej wzwyż nic nie było jeszcze zapisane
+    ZABLOKUJ_STERTE();
+    char *czyste_od = *sterta_czysta_pamiec();
     void *alokuj = heap_malloc(wielkosc);
+    size_t do_wyczyszczenia = alokuj != NULL ? calloc_brudne_bajty(alokuj, wielkosc, czyste_od) : 0;
+    ODBLOKUJ_STERTE();
     if (alokuj == NULL) {
         return NULL;
     }
 
-    memset(alokuj, 0, wielkosc);
+    // Czyszczona jest tylko część, która mogła być wcześniej zapisana (poza blokadą sterty)
+    memset(alokuj, 0, do_wyczyszczenia);
     return alokuj;
 }
+size_t calloc_brudne_bajty(void *wskaznik, size_t rozmiar, const char *czyste_od) {
+    // Obiekty slabów i pamięci podręcznych wątków były już używane - czyszczone są w całości
+    if (slab_znajdz(wskaznik) != NULL) {
+        return rozmiar;
+    }
+    struct memory_chunk_t *blok = (struct memory_chunk_t *) ((char *) wskaznik - POCZATEK_DANYCH);
+    if (kawalek_wlasciciel(blok) != 0) {
+        return rozmiar;
+    }
+
+    // Świeże anonimowe odwzorowanie jest wyzerowane przez system
+    if (blok->rodzaj == RODZAJ_MMAP) {
+        return 0;
+    }
+
+    // Na stercie brudny może być tylko początek danych leżący poniżej granicy czystej pamięci
+    if ((char *) wskaznik >= czyste_od) {
+        return 0;
+    }
+    size_t brudne = (size_t) (czyste_od - (char *) wskaznik);
+    return brudne < rozmiar ? brudne : rozmiar;
+}
+void calloc_oznacz_zapisane(char *koniec) {
+    // Granica czystej pamięci przesuwa się za każdy zapis ponad nią
+    char **czyste_od = sterta_czysta_pamiec();
+    if (koniec > *czyste_od) {
+        *czyste_od = koniec;
+    }
+}
+void calloc_oznacz_wydany(struct memory_chunk_t *blok) {
+    // Ponad granicą czystej pamięci mogła leżeć jedynie stopka wolnego bloku kończącego stertę - znika przed wydaniem
+    // obszaru, który od teraz może zapisywać użytkownik
+    char *koniec = (char *) blok + WIELKOSC_CHUNK + obszar_bloku(blok);
+    char *czyste_od = *sterta_czysta_pamiec();
+    if (koniec <= czyste_od) {
+        return;
+    }
+    char *stopka = koniec - sizeof(size_t);
+    char *od = stopka > czyste_od ? stopka : czyste_od;
+    memset(od, 0, (size_t) (koniec - od));
+    calloc_oznacz_zapisane(koniec);
+}
 
 int sprawdzaj_plotka(struct memory_chunk_t *kawalek) {
     char *poczatek = (char *) kawalek + WIELKOSC_CHUNK;
-    char *koniec = (char *) kawalek + 4 + WIELKOSC_CHUNK + kawalek->wielkosc;
-    const char expected_fence[4] = {'#', '#', '#', '#'};
+    char *koniec = (char *) kawalek + POCZATEK_DANYCH + kawalek->wielkosc;
 
-    if (memcmp(poczatek, expected_fence, 4) != 0 || memcmp(koniec, expected_fence, 4) != 0) {
-        return 0;
+    for (size_t i = 0; i < PLOTEK_PRZED; i++) {
+        if (poczatek[i] != '#') {
+            return 0;
+        }
+    }
+    for (size_t i = 0; i < PLOTEK_ZA; i++) {
+        if (koniec[i] != '#') {
+            return 0;
+        }
     }
     return 1;
 }
 int heap_validate(void) {
+    ZABLOKUJ_STERTE();
+    int wynik = walidacja_pelna();
+    ODBLOKUJ_STERTE();
+    return wynik;
+}
+int walidacja_pelna(void) {
     if (memory_manager.poczatek == NULL) {
         return 2;
     }
     for (struct memory_chunk_t *current_chunk = memory_manager.pierwszy_kawalek;
          current_chunk != NULL;
-         current_chunk = current_chunk->nastepny) {
+         current_chunk = KAWALEK_NASTEPNY(current_chunk)) {
         if (current_chunk->checksuma != oblicz_checksuma(current_chunk)) {
             return 3;
         }
 
+        // Znaczniki graniczne muszą zgadzać się z listą bloków
+        int poprzedni_wolny = KAWALEK_POPRZEDNI(current_chunk) != NULL && KAWALEK_POPRZEDNI(current_chunk)->czy_wolny;
+        if (current_chunk->poprzedni_wolny != poprzedni_wolny ||
+            (current_chunk->czy_wolny && *znacznik_stopka(current_chunk) != current_chunk->wielkosc)) {
+            return 3;
+        }
+
         if (current_chunk->czy_wolny == 0 && !sprawdzaj_plotka(current_chunk)) {
             return 1;
         }
+
+        if (current_chunk->rodzaj == RODZAJ_SLAB && !slab_sprawdz(current_chunk)) {
+            return 3;
+        }
+    }
+
+    // Bloki mapowane mają te same nagłówki i płotki co bloki sterty
+    for (struct memory_chunk_t *duzy_blok = memory_manager.duze_bloki; duzy_blok != NULL; duzy_blok = KAWALEK_NASTEPNY(duzy_blok)) {
+        int wynik = walidacja_bloku(duzy_blok);
+        if (wynik != 0) {
+            return wynik;
+        }
     }
 
     return 0;
 }
+int walidacja_bloku(struct memory_chunk_t *kawalek) {
+    // Sprawdzenie pojedynczego bloku: suma kontrolna nagłówka, stopka wolnego i płotki zajętego bloku
+    if (kawalek->checksuma != oblicz_checksuma(kawalek)) {
+        return 3;
+    }
+    if (kawalek->czy_wolny && *znacznik_stopka(kawalek) != kawalek->wielkosc) {
+        return 3;
+    }
+    if (kawalek->czy_wolny == 0 && !sprawdzaj_plotka(kawalek)) {
+        return 1;
+    }
+    if (kawalek->rodzaj == RODZAJ_SLAB && !slab_sprawdz(kawalek)) {
+        return 3;
+    }
+    return 0;
+}
+int walidacja_globalna(void) {
+    // Sterta otwarta z pliku jest przy pierwszej operacji sprawdzana w całości
+    if (memory_manager.odroczone_sprawdzenie) {
+        return plik_dokoncz_otwarcie();
+    }
+    switch (memory_manager.tryb_walidacji) {
+        case heap_validation_full:
+            return walidacja_pelna();
+        case heap_validation_sampled:
+            // Pełne przejście sterty tylko co okres_walidacji operacji
+            if (++memory_manager.licznik_operacji >= memory_manager.okres_walidacji) {
+                memory_manager.licznik_operacji = 0;
+                return walidacja_pelna();
+            }
+            return memory_manager.poczatek == NULL ? 2 : 0;
+        default:
+            return memory_manager.poczatek == NULL ? 2 : 0;
+    }
+}
+int walidacja_lokalna(struct memory_chunk_t *kawalek) {
+    // Tryby off i full nie sprawdzają pojedynczych bloków (full zrobił to już w całości)
+    if (kawalek == NULL || memory_manager.tryb_walidacji == heap_validation_off ||
+        memory_manager.tryb_walidacji == heap_validation_full) {
+        return 0;
+    }
 
-
+    // Blok, którego dotyczy operacja, oraz jego bezpośredni sąsiedzi
+    int wynik = walidacja_bloku(kawalek);
+    if (wynik == 0 && KAWALEK_POPRZEDNI(kawalek)) {
+        wynik = walidacja_bloku(KAWALEK_POPRZEDNI(kawalek));
+    }
+    if (wynik == 0 && KAWALEK_NASTEPNY(kawalek)) {
+        wynik = walidacja_bloku(KAWALEK_NASTEPNY(kawalek));
+    }
+    return wynik;
+}
+int heap_configure(enum heap_option_t opcja, size_t wartosc) {
+    int wynik = -1;
+    ZABLOKUJ_STERTE();
+    switch (opcja) {
+        case heap_option_validation:
+            if (wartosc <= heap_validation_full) {
+                // Tryb odczytuje także zwolnienie do pamięci podręcznej wątku, wykonywane bez blokady
+                __atomic_store_n(&memory_manager.tryb_walidacji, (enum heap_validation_t) wartosc, __ATOMIC_RELAXED);
+                wynik = 0;
+            }
+            break;
+        case heap_option_validation_period:
+            if (wartosc != 0) {
+                memory_manager.okres_walidacji = wartosc;
+                memory_manager.licznik_operacji = 0;
+                wynik = 0;
+            }
+            break;
+        case heap_option_slabs:
+            // Klasę rozmiaru wybiera także przydział z pamięci podręcznej wątku, wykonywany bez blokady
+            __atomic_store_n(&memory_manager.slaby_wlaczone, wartosc != 0, __ATOMIC_RELAXED);
+            wynik = 0;
+            break;
+        case heap_option_mmap_threshold:
+            // Odwzorowania mmap nie trafiłyby do pliku sterty
+            if (wartosc == 0 || !memory_manager.obszar.plik) {
+                memory_manager.prog_mmap = wartosc;
+                wynik = 0;
+            }
+            break;
+        case heap_option_trim_threshold:
+            memory_manager.prog_przycinania = wartosc;
+            wynik = 0;
+            break;
+        case heap_option_placement:
+            if (wartosc <= heap_placement_best_fit) {
+                memory_manager.polityka_rozmieszczenia = (enum heap_placement_t) wartosc;
+                memory_manager.wedrowny = NULL;
+                wynik = 0;
+            }
+            break;
+        case heap_option_growth_min:
+            // Przyrosty liczone są od nowa od najmniejszego (wyrównanego tak jak obszary bloków)
+            if (wartosc <= memory_manager.przyrost_max) {
+                memory_manager.przyrost_min = (wartosc + WYROWNANIE - 1) & ~(size_t) (WYROWNANIE - 1);
+                memory_manager.przyrost = memory_manager.przyrost_min;
+                wynik = 0;
+            }
+            break;
+        case heap_option_growth_max:
+            wartosc &= ~(size_t) (WYROWNANIE - 1);
+            if (wartosc >= memory_manager.przyrost_min) {
+                memory_manager.przyrost_max = wartosc;
+                if (memory_manager.przyrost > wartosc) {
+                    memory_manager.przyrost = wartosc;
+                }
+                wynik = 0;
+            }
+            break;
+    }
+    ODBLOKUJ_STERTE();
+    return wynik;
+}
 
 
 void *heap_realloc(void *memblock, size_t count) {
+    if (slad_aktywny()) {
+        return slad_realloc(memblock, count);
+    }
+    POMIAR_START();
+    ZABLOKUJ_STERTE();
+    void *wynik = realloc_wykonaj(memblock, count);
+    realloc_policz(memblock, wynik);
+    ODBLOKUJ_STERTE();
+    POMIAR_KONIEC(czas_realloc);
+    return wynik;
+}
+void *heap_realloc_sized(void *memblock, size_t old_size, size_t count) {
+    // Przypadki szczególne (nowy blok, zwolnienie) obsługują zwykłe funkcje
+    if (slad_aktywny() || memblock == NULL) {
+        return heap_realloc(memblock, count);
+    }
+    if (count == 0) {
+        heap_free_sized(memblock, old_size);
+        return NULL;
+    }
+    POMIAR_START();
+    ZABLOKUJ_STERTE();
+    void *wynik = realloc_rozmiar_wykonaj(memblock, old_size, count);
+    realloc_policz(memblock, wynik);
+    ODBLOKUJ_STERTE();
+    POMIAR_KONIEC(czas_realloc);
+    return wynik;
+}
+void realloc_policz(void *stary_blok, void *nowy_blok) {
+    // Zmiana rozmiaru istniejącego bloku - w miejscu albo z przeniesieniem danych
+    if (stary_blok != NULL && nowy_blok != NULL) {
+        if (nowy_blok == stary_blok) {
+            memory_manager.statystyki.realloc_w_miejscu++;
+        } else {
+            memory_manager.statystyki.realloc_przeniesione++;
+        }
+    }
+}
+void *realloc_wykonaj(void *memblock, size_t count) {
     int wynik = realloc_sprawdz_warunki_poczatkowe(memblock, count);
     if (wynik == 0) {
         return NULL;
     } else if (wynik == 2) {
         return heap_malloc(count);
     }
+    return realloc_zmien(memblock, count, slab_znajdz(memblock));
+}
+void *realloc_rozmiar_wykonaj(void *memblock, size_t stary_rozmiar, size_t count) {
+    if (memory_manager.poczatek == NULL) {
+        return NULL;
+    }
+
+    // W trybach walidacji wskaźnik przechodzi zwykłe sprawdzenie, a podany rozmiar porównywany jest z blokiem
+    if (rozmiar_sprawdzany()) {
+        if (wskaznik_okresl_typ(memblock) != pointer_valid || !rozmiar_zgodny(memblock, stary_rozmiar)) {
+            return NULL;
+        }
+        return realloc_zmien(memblock, count, slab_znajdz(memblock));
+    }
+
+    // Bez walidacji rozmiar zastępuje wyszukiwanie bloku - obiektem slabu może być tylko mały blok
+    return realloc_zmien(memblock, count, stary_rozmiar <= NAJWIEKSZY_OBIEKT_SLABU ? slab_znajdz(memblock) : NULL);
+}
+void *realloc_zmien(void *memblock, size_t count, struct slab_t *slab) {
+    // Obiekt slabu mieści się w swojej klasie albo jest przenoszony do większego bloku
+    if (slab != NULL) {
+        if (count <= slab->rozmiar_obiektu) {
+            return memblock;
+        }
+        void *nowy_blok = malloc_wykonaj(count);
+        if (nowy_blok != NULL) {
+            memcpy(nowy_blok, memblock, slab->rozmiar_obiektu);
+            slab_zwolnij(slab, memblock);
+        }
+        return nowy_blok;
+    }
 
-    struct memory_chunk_t *memory_block = (struct memory_chunk_t *)((char *)memblock - WIELKOSC_CHUNK - 4);
-    struct memory_chunk_t *memory_block_next = memory_block->nastepny;
+    struct memory_chunk_t *memory_block = (struct memory_chunk_t *)((char *)memblock - POCZATEK_DANYCH);
+
+    // Blok mapowany zmienia rozmiar całego odwzorowania zamiast kopiować dane
+    if (memory_block->rodzaj == RODZAJ_MMAP) {
+        return mmap_zmien_rozmiar(memory_block, count);
+    }
 
     if (memory_block->wielkosc == count) {
         return memblock;
     }
 
-    return realloc_zdecyduj(memblock, count, memory_block, memory_block_next);
+    // Blok z pamięci podręcznej wątku ma stały rozmiar klasy - mieści się w nim albo trzeba go przenieść
+    if (kawalek_wlasciciel(memory_block) != 0) {
+        return count < memory_block->wielkosc ? memblock : realloc_przydziel_nowy_blok(memory_block, count);
+    }
+
+    return realloc_zdecyduj(memblock, count, memory_block);
 }
 
 int realloc_sprawdz_warunki_poczatkowe(void *blok_pamieci, size_t rozmiar) {
-    if (memory_manager.poczatek == NULL || heap_validate() != 0) {
+    if (memory_manager.poczatek == NULL) {
         return 0; // Nieudane sprawdzenie
     }
 
     if (blok_pamieci == NULL) {
-        return 2; // Specjalny przypadek: alokacja nowego bloku
+        return 2; // Specjalny przypadek: alokacja nowego bloku (heap_malloc sam waliduje stertę)
     }
 
-    if (get_pointer_type(blok_pamieci) != pointer_valid) {
+    // Określenie typu wskaźnika waliduje stertę zgodnie z trybem walidacji
+    if (wskaznik_okresl_typ(blok_pamieci) != pointer_valid) {
         return 0; // Nieudane sprawdzenie
     }
 
@@ -239,257 +985,2297 @@ int realloc_sprawdz_warunki_poczatkowe(void *blok_pamieci, size_t rozmiar) {
 
     return 1; // Pomyślne sprawdzenie
 }
-void *realloc_zdecyduj(void *blok_pamieci, size_t nowy_rozmiar, struct memory_chunk_t *aktualny_blok, struct memory_chunk_t *nastepny_blok) {
+void *realloc_zdecyduj(void *blok_pamieci, size_t nowy_rozmiar, struct memory_chunk_t *aktualny_blok) {
     if (nowy_rozmiar < aktualny_blok->wielkosc) {
-        return realloc_zmniejsz(blok_pamieci, nowy_rozmiar, aktualny_blok);
+        return realloc_ustaw_rozmiar(blok_pamieci, nowy_rozmiar, aktualny_blok);
     }
     if (nowy_rozmiar > aktualny_blok->wielkosc) {
-        if (nastepny_blok != NULL) {
-            return realloc_rozszerz_w_miejscu(blok_pamieci, nowy_rozmiar, aktualny_blok, nastepny_blok);
-        }
-        return realloc_rozszerz_z_sbrk(aktualny_blok, nowy_rozmiar);
+        return realloc_rozszerz(blok_pamieci, nowy_rozmiar, aktualny_blok);
     }
     return NULL;
 }
-void realloc_dostosuj_bloki_pamieci(struct memory_chunk_t *blok_pamieci, struct memory_chunk_t *nastepny_blok_pamieci, size_t nowy_rozmiar) {
-    // Ustawienie wskaźników między blokami
-    nastepny_blok_pamieci->poprzedni = blok_pamieci;
-    blok_pamieci->nastepny = nastepny_blok_pamieci->nastepny;
+size_t realloc_obszar_z_zapasem(size_t rozmiar) {
+    // Rosnący blok dostaje zapas połowy swojego rozmiaru - kolejne powiększenia mieszczą się w nim bez kopiowania
+    size_t zapas = rozmiar / 2;
+    return malloc_wymagany_obszar(rozmiar + zapas < rozmiar ? rozmiar : rozmiar + zapas);
+}
+void *realloc_rozszerz(void *blok_pamieci, size_t rozmiar, struct memory_chunk_t *aktualny_blok) {
+    size_t potrzeba = malloc_wymagany_obszar(rozmiar);
+    size_t obszar = obszar_bloku(aktualny_blok);
 
-    // Aktualizacja wielkości bloku
-    blok_pamieci->wielkosc = nowy_rozmiar;
+    // Zapas pozostawiony przy poprzednim powiększeniu
+    if (obszar >= potrzeba) {
+        return realloc_ustaw_rozmiar(blok_pamieci, rozmiar, aktualny_blok);
+    }
 
-    // Ustawienie danych kontrolnych i obliczenie sumy kontrolnej
-    char *dane = (char *)blok_pamieci + WIELKOSC_CHUNK + 4 + nowy_rozmiar;
-    for (int i = 0; i < 4; i++) {
-        dane[i] = '#';
+    // Obszar osiągalny w przód: wolny następnik, a na końcu sterty także nowa pamięć z custom_sbrk
+    struct memory_chunk_t *nastepny_blok = KAWALEK_NASTEPNY(aktualny_blok);
+    int nastepny_wolny = nastepny_blok != NULL && nastepny_blok->czy_wolny;
+    size_t obszar_w_przod = obszar + (nastepny_wolny ? WIELKOSC_CHUNK + nastepny_blok->wielkosc : 0);
+    if (obszar_w_przod < potrzeba && (nastepny_blok == NULL || (nastepny_wolny && KAWALEK_NASTEPNY(nastepny_blok) == NULL))) {
+        size_t docelowy = realloc_obszar_z_zapasem(rozmiar);
+        obszar_w_przod += wzrost_dopisz(docelowy - obszar_w_przod, potrzeba - obszar_w_przod);
+    }
+    if (obszar_w_przod >= potrzeba) {
+        if (nastepny_wolny) {
+            realloc_wchlon_nastepny(aktualny_blok);
+        }
+        return realloc_ustaw_rozmiar(blok_pamieci, rozmiar, aktualny_blok);
+    }
+
+    // Wolny poprzednik - dane przesuwane są wstecz (obszary mogą się nakładać)
+    struct memory_chunk_t *poprzedni_blok = znacznik_poprzedni_wolny(aktualny_blok);
+    if (poprzedni_blok != NULL && WIELKOSC_CHUNK + poprzedni_blok->wielkosc + obszar_w_przod >= potrzeba) {
+        if (nastepny_wolny) {
+            realloc_wchlon_nastepny(aktualny_blok);
+        }
+        aktualny_blok = realloc_wchlon_poprzedni(aktualny_blok);
+        return realloc_ustaw_rozmiar((char *) aktualny_blok + POCZATEK_DANYCH, rozmiar, aktualny_blok);
+    }
+
+    return realloc_przydziel_nowy_blok(aktualny_blok, rozmiar);
+}
+void realloc_wchlon_nastepny(struct memory_chunk_t *blok) {
+    // Wchłaniany wolny blok znika z koszy, z indeksu i z listy - jego obszar przechodzi na blok
+    struct memory_chunk_t *nastepny_blok = KAWALEK_NASTEPNY(blok);
+    kosze_usun(nastepny_blok);
+    indeks_usun(nastepny_blok);
+
+    KAWALEK_USTAW_NASTEPNY(blok, KAWALEK_NASTEPNY(nastepny_blok));
+    if (KAWALEK_NASTEPNY(blok)) {
+        KAWALEK_USTAW_POPRZEDNI(KAWALEK_NASTEPNY(blok), blok);
+        KAWALEK_NASTEPNY(blok)->checksuma = oblicz_checksuma(KAWALEK_NASTEPNY(blok));
+    } else {
+        memory_manager.ostatni_kawalek = blok;
     }
-    blok_pamieci->checksuma = oblicz_checksuma(blok_pamieci);
+    blok->checksuma = oblicz_checksuma(blok);
+}
+struct memory_chunk_t *realloc_wchlon_poprzedni(struct memory_chunk_t *blok) {
+    // Poprzednik opuszcza kosz i przejmuje obszar bloku, którego nagłówek znika z indeksu i z listy
+    struct memory_chunk_t *poprzedni_blok = znacznik_poprzedni_wolny(blok);
+    size_t rozmiar_danych = blok->wielkosc;
+    kosze_usun(poprzedni_blok);
+    indeks_usun(blok);
+
+    KAWALEK_USTAW_NASTEPNY(poprzedni_blok, KAWALEK_NASTEPNY(blok));
+    if (KAWALEK_NASTEPNY(poprzedni_blok)) {
+        KAWALEK_USTAW_POPRZEDNI(KAWALEK_NASTEPNY(poprzedni_blok), poprzedni_blok);
+        KAWALEK_NASTEPNY(poprzedni_blok)->checksuma = oblicz_checksuma(KAWALEK_NASTEPNY(poprzedni_blok));
+    } else {
+        memory_manager.ostatni_kawalek = poprzedni_blok;
+    }
+    poprzedni_blok->czy_wolny = 0;
+
+    // Dane trafiają na początek obszaru poprzednika (memmove - cel i źródło mogą się nakładać)
+    memmove((char *) poprzedni_blok + POCZATEK_DANYCH, (char *) blok + POCZATEK_DANYCH, rozmiar_danych);
+    poprzedni_blok->wielkosc = rozmiar_danych;
+    return poprzedni_blok;
 }
 void *realloc_przydziel_nowy_blok(struct memory_chunk_t *kawalek_pamieci, size_t rozmiar) {
-    // Alokacja nowego bloku pamięci
-    void *nowy_blok = heap_malloc(rozmiar);
+    // Przeniesiony blok sterty dostaje zapas na dalsze powiększenia; slaby i odwzorowania mmap mają własne rozmiary
+    void *nowy_blok;
+    size_t z_zapasem = rozmiar + rozmiar / 2;
+    if (z_zapasem > rozmiar && malloc_zwykly_blok(rozmiar) && malloc_zwykly_blok(z_zapasem)) {
+        nowy_blok = malloc_wykonaj(z_zapasem);
+        if (nowy_blok != NULL) {
+            struct memory_chunk_t *nowy_kawalek = (struct memory_chunk_t *) ((char *) nowy_blok - POCZATEK_DANYCH);
+            nowy_kawalek->wielkosc = rozmiar;
+            malloc_inicjalizuj_blok_pamieci(nowy_kawalek);
+            nowy_kawalek->checksuma = oblicz_checksuma(nowy_kawalek);
+            statystyki_przydzial(rozmiar);
+        }
+    } else {
+        nowy_blok = heap_malloc(rozmiar);
+    }
     if (!nowy_blok) {
         return NULL;
     }
 
     // Kopiowanie danych do nowego bloku i zwolnienie starego
-    memcpy(nowy_blok, (char *)kawalek_pamieci + WIELKOSC_CHUNK + 4, kawalek_pamieci->wielkosc);
-    heap_free((char *)kawalek_pamieci + WIELKOSC_CHUNK + 4);
+    memcpy(nowy_blok, (char *)kawalek_pamieci + POCZATEK_DANYCH, kawalek_pamieci->wielkosc);
+    heap_free((char *)kawalek_pamieci + POCZATEK_DANYCH);
 
     return nowy_blok;
 }
-void *realloc_rozszerz_w_miejscu(void *blok_pamieci, size_t rozmiar, struct memory_chunk_t *aktualny_blok, struct memory_chunk_t *nastepny_blok) {
-    // Bezpośrednie obliczenie adresu początkowego następnego bloku
-    char *poczatek = (char *)nastepny_blok + sizeof(struct memory_chunk_t) + nastepny_blok->wielkosc + 8;
-
-    // Obliczenie całkowitej przestrzeni między blokami
-    size_t laczna_przestrzen = (size_t)(poczatek - (char *)aktualny_blok);
-    size_t wolna_przestrzen = laczna_przestrzen - WIELKOSC_CHUNK - 8;
-
-    // Warunek sprawdzający czy dostępna przestrzeń jest wystarczająca
-    if (wolna_przestrzen >= rozmiar) {
-        // Dostosowanie bloków pamięci
-        realloc_dostosuj_bloki_pamieci(aktualny_blok, nastepny_blok, rozmiar);
-        return blok_pamieci;
-    } else {
-        // Alokacja nowego bloku pamięci
-        return realloc_przydziel_nowy_blok(aktualny_blok, rozmiar);
-    }
-}
-void *realloc_zmniejsz(void *blok_pamieci, size_t nowy_rozmiar, struct memory_chunk_t *kawalek_pamieci) {
-    // Ustawienie nowego rozmiaru bloku pamięci
+void *realloc_ustaw_rozmiar(void *blok_pamieci, size_t nowy_rozmiar, struct memory_chunk_t *kawalek_pamieci) {
+    // Nowy rozmiar danych wraz z płotkami (przedni mógł zostać nadpisany, gdy obszar należał do wolnego bloku)
     kawalek_pamieci->wielkosc = nowy_rozmiar;
-
-    // Obliczenie wskaźnika na obszar zaalokowany po strukturze memory_chunk_t
-    char *dane = (char *)kawalek_pamieci + sizeof(struct memory_chunk_t) + 4 + kawalek_pamieci->wielkosc;
-
-    // Wypełnienie 4 bajtów po zakończeniu bloku pamięci znakami '#'
-    for (int i = 0; i < 4; i++) {
-        dane[i] = '#';
-    }
-
-    // Obliczenie i zapisanie nowej sumy kontrolnej
+    calloc_oznacz_wydany(kawalek_pamieci);
+    malloc_inicjalizuj_blok_pamieci(kawalek_pamieci);
     kawalek_pamieci->checksuma = oblicz_checksuma(kawalek_pamieci);
 
-    // Zwrócenie wskaźnika na blok pamięci
+    // Obszar ponad zapas dla nowego rozmiaru wraca na stertę jako wolny blok
+    struct memory_chunk_t *reszta = podziel_blok(kawalek_pamieci, realloc_obszar_z_zapasem(nowy_rozmiar));
+    if (reszta != NULL) {
+        free_zwolnij_blok(reszta);
+    }
     return blok_pamieci;
 }
-void *realloc_rozszerz_z_sbrk(struct memory_chunk_t blok_pamieci[], size_t nowy_rozmiar) {
-    size_t rozmiar = nowy_rozmiar - blok_pamieci->wielkosc;
-
-    // Uzyskaj dodatkową pamięć
-    void *pamiec = custom_sbrk((intptr_t)rozmiar);
-    if (pamiec == (void *)-1) {
-        return NULL;
-    }
 
-    // Aktualizuj rozmiar bloku
-    blok_pamieci->wielkosc = nowy_rozmiar;
-    memory_manager.wielkosc_pamieci += rozmiar;
 
-    // Ustaw nowe ogrodzenie pamięci
-    char *dane = (char *)blok_pamieci + 4 + WIELKOSC_CHUNK  + blok_pamieci->wielkosc;
-    for (size_t i = 0; i < 4; i++) {
-        dane[i] = '#';
+void heap_free(void *blok_pamieci) {
+    if (slad_aktywny()) {
+        slad_free(blok_pamieci);
+        return;
     }
-
-    // Zaktualizuj sumę kontrolną
-    blok_pamieci->checksuma = oblicz_checksuma(blok_pamieci);
-
-    // Zwróć wskaźnik do nowo przydzielonego bloku pamięci
-    char *nowy_adres = (char *)blok_pamieci + 4 + WIELKOSC_CHUNK;
-    return (void *)nowy_adres;
+    POMIAR_START();
+#ifdef HEAP_THREAD_SAFE
+    // Bloki należące do pamięci podręcznej wątku wracają do niej bez blokady
+    if (pamiec_watku_zwolnij(blok_pamieci)) {
+        POMIAR_KONIEC(czas_free);
+        return;
+    }
+#endif
+    ZABLOKUJ_STERTE();
+    free_wykonaj(blok_pamieci);
+    ODBLOKUJ_STERTE();
+    POMIAR_KONIEC(czas_free);
 }
-
-
-void heap_free(void *blok_pamieci) {
+void free_wykonaj(void *blok_pamieci) {
     // Sprawdzenie, czy blok pamięci jest niepusty i czy menedżer pamięci jest poprawnie zainicjalizowany
-    if (!blok_pamieci || heap_validate() != 0 || !memory_manager.poczatek || !memory_manager.pierwszy_kawalek) {
+    if (!blok_pamieci || !memory_manager.poczatek || walidacja_globalna() != 0) {
         return;
     }
 
-    // Obliczenie adresu aktualnego bloku pamięci
-    struct memory_chunk_t *aktualny_blok = (struct memory_chunk_t *)((char *)blok_pamieci - 4 - WIELKOSC_CHUNK);
+    if (free_zwolnij_wskaznik(blok_pamieci)) {
+        przycinanie_automatyczne();
+    }
+}
+void heap_free_sized(void *blok_pamieci, size_t rozmiar) {
+    if (slad_aktywny()) {
+        slad_free(blok_pamieci);
+        return;
+    }
+    POMIAR_START();
+#ifdef HEAP_THREAD_SAFE
+    if (pamiec_watku_zwolnij(blok_pamieci)) {
+        POMIAR_KONIEC(czas_free);
+        return;
+    }
+#endif
+    ZABLOKUJ_STERTE();
+    free_rozmiar_wykonaj(blok_pamieci, rozmiar);
+    ODBLOKUJ_STERTE();
+    POMIAR_KONIEC(czas_free);
+}
+void free_rozmiar_wykonaj(void *blok_pamieci, size_t rozmiar) {
+    if (!blok_pamieci || !memory_manager.poczatek) {
+        return;
+    }
 
-    // Sprawdzenie, czy blok jest już zwolniony lub czy jego rozmiar jest większy niż cała dostępna pamięć
-    if (aktualny_blok->czy_wolny || aktualny_blok->wielkosc > memory_manager.wielkosc_pamieci) {
+    // W trybach walidacji wskaźnik przechodzi zwykłe sprawdzenie, a podany rozmiar porównywany jest z blokiem
+    if (rozmiar_sprawdzany()) {
+        if (wskaznik_okresl_typ(blok_pamieci) == pointer_valid && rozmiar_zgodny(blok_pamieci, rozmiar) &&
+            free_zwolnij_wskaznik(blok_pamieci)) {
+            przycinanie_automatyczne();
+        }
         return;
     }
 
-    // Oznaczenie bloku jako wolnego
-    aktualny_blok->czy_wolny = 1;
+    if (free_zwolnij_znany(blok_pamieci, rozmiar)) {
+        przycinanie_automatyczne();
+    }
+}
+int free_zwolnij_znany(void *blok_pamieci, size_t rozmiar) {
+    // Obiektem slabu może być tylko mały blok - większe od razu mają własny nagłówek przed danymi
+    if (rozmiar <= NAJWIEKSZY_OBIEKT_SLABU) {
+        struct slab_t *slab = slab_znajdz(blok_pamieci);
+        if (slab != NULL) {
+            slab_zwolnij(slab, blok_pamieci);
+            return 1;
+        }
+    }
 
-    // Obsługa przypadku, gdy jest to jedyny blok w zarządzanej pamięci
-    if (!aktualny_blok->nastepny && !aktualny_blok->poprzedni) {
-        memory_manager.pierwszy_kawalek = NULL;
-        return;
+    // Rodzaj bloku z nagłówka zastępuje przeszukanie listy odwzorowań i indeksu adresów
+    struct memory_chunk_t *aktualny_blok = (struct memory_chunk_t *) ((char *) blok_pamieci - POCZATEK_DANYCH);
+    if (aktualny_blok->rodzaj == RODZAJ_MMAP) {
+        mmap_zwolnij(aktualny_blok);
+        return 0;
+    }
+    if (aktualny_blok->czy_wolny || aktualny_blok->rodzaj != RODZAJ_ZWYKLY) {
+        return 0;
+    }
+    free_zwolnij_blok(aktualny_blok);
+    return 1;
+}
+int free_zwolnij_wskaznik(void *blok_pamieci) {
+    // Zwraca 1, gdy blok lub obiekt slabu został zwolniony. Blok mapowany wraca do systemu w całości; szukany jest tylko dla wskaźników spoza sterty
+    if (!sterta_obejmuje(blok_pamieci)) {
+        struct memory_chunk_t *zmapowany = mmap_znajdz(blok_pamieci);
+        if (zmapowany != NULL && (char *) blok_pamieci == (char *) zmapowany + POCZATEK_DANYCH &&
+            walidacja_lokalna(zmapowany) == 0) {
+            mmap_zwolnij(zmapowany);
+            return 1;
+        }
+        return 0;
     }
 
-    // Aktualizacja rozmiaru bloku, jeśli istnieje następny blok
-    if (aktualny_blok->nastepny) {
-        aktualny_blok->wielkosc = (char *)aktualny_blok->nastepny - (char *)aktualny_blok - WIELKOSC_CHUNK;
+    // Obiekty slabów nie mają własnych nagłówków - zwalnia je slab
+    struct slab_t *slab = slab_znajdz(blok_pamieci);
+    if (slab != NULL) {
+        if (walidacja_lokalna(slab_kawalek(slab)) != 0) {
+            return 0;
+        }
+        return slab_zwolnij(slab, blok_pamieci);
     }
 
-    // Scalanie z poprzednim blokiem, jeśli jest wolny
-    if (aktualny_blok->poprzedni && aktualny_blok->poprzedni->czy_wolny) {
-        free_scal_z_poprzednim(&aktualny_blok);
+    // Wskaźnik musi być wyrównany i leżeć w obszarze sterty, zanim odczytamy nagłówek bloku
+    if ((uintptr_t) blok_pamieci % WYROWNANIE != 0 ||
+        (char *) blok_pamieci < (char *) memory_manager.pierwszy_kawalek + POCZATEK_DANYCH ||
+        (char *) blok_pamieci >= (char *) memory_manager.poczatek + memory_manager.wielkosc_pamieci) {
+        return 0;
+    }
+
+    // Obliczenie adresu aktualnego bloku pamięci; indeks potwierdza, że wskaźnik to początek danych bloku
+    struct memory_chunk_t *aktualny_blok = (struct memory_chunk_t *)((char *)blok_pamieci - POCZATEK_DANYCH);
+    struct memory_chunk_t *wlasciciel = indeks_znajdz(blok_pamieci);
+    if (wlasciciel != NULL && wlasciciel != aktualny_blok) {
+        return 0;
+    }
+    if (walidacja_lokalna(aktualny_blok) != 0) {
+        return 0;
+    }
+
+    // Sprawdzenie, czy blok jest już zwolniony (także do pamięci podręcznej wątku) lub czy jego rozmiar jest większy
+    // niż cała dostępna pamięć
+    if (aktualny_blok->czy_wolny || kawalek_w_pamieci_watku(aktualny_blok) ||
+        aktualny_blok->wielkosc > memory_manager.wielkosc_pamieci) {
+        return 0;
     }
 
-    // Scalanie z następnym blokiem, jeśli jest wolny
-    if (aktualny_blok->nastepny && aktualny_blok->nastepny->czy_wolny) {
+    free_zwolnij_blok(aktualny_blok);
+    return 1;
+}
+void free_zwolnij_blok(struct memory_chunk_t *aktualny_blok) {
+    // Oznaczenie bloku jako wolnego
+    aktualny_blok->czy_wolny = 1;
+
+    // Wolny blok obejmuje cały obszar aż do następnego bloku (lub końca sterty)
+    aktualny_blok->wielkosc = obszar_bloku(aktualny_blok);
+
+    // Sąsiedzi wynikają ze znaczników granicznych: poprzedni wolny blok ze stopki, następny z zasięgu bloku
+    if (znacznik_poprzedni_wolny(aktualny_blok) != NULL) {
+        free_scal_z_poprzednim(&aktualny_blok);
+    }
+    struct memory_chunk_t *nastepny_blok = znacznik_nastepny(aktualny_blok);
+    if (nastepny_blok != NULL && nastepny_blok->czy_wolny) {
         free_scal_z_nastepnym(aktualny_blok);
     }
 
-    // Aktualizacja metadanych dla wszystkich bloków
-    for (aktualny_blok = memory_manager.pierwszy_kawalek; aktualny_blok; aktualny_blok = aktualny_blok->nastepny) {
-        aktualny_blok->checksuma = oblicz_checksuma(aktualny_blok);
+    // Umieszczenie scalonego bloku w koszu odpowiadającym jego rozmiarowi
+    kosze_wstaw(aktualny_blok);
+
+    // Nagłówki zmieniły się tylko w scalonym bloku i w jego następniku (wskaźnik poprzedni)
+    aktualny_blok->checksuma = oblicz_checksuma(aktualny_blok);
+    if (KAWALEK_NASTEPNY(aktualny_blok)) {
+        KAWALEK_NASTEPNY(aktualny_blok)->checksuma = oblicz_checksuma(KAWALEK_NASTEPNY(aktualny_blok));
     }
 }
 void free_scal_z_poprzednim(struct memory_chunk_t **aktualny_blok) {
-    if (!aktualny_blok || !*aktualny_blok || !(*aktualny_blok)->poprzedni) {
+    if (!aktualny_blok || !*aktualny_blok || !znacznik_poprzedni_wolny(*aktualny_blok)) {
         return;
     }
 
-    struct memory_chunk_t *poprzedni = (*aktualny_blok)->poprzedni;
+    // Poprzedni blok zmienia rozmiar, więc opuszcza swój kosz, a nagłówek bieżącego znika z indeksu
+    struct memory_chunk_t *poprzedni = znacznik_poprzedni_wolny(*aktualny_blok);
+    kosze_usun(poprzedni);
+    indeks_usun(*aktualny_blok);
     poprzedni->wielkosc += (*aktualny_blok)->wielkosc + WIELKOSC_CHUNK;
-    poprzedni->nastepny = (*aktualny_blok)->nastepny;
+    KAWALEK_USTAW_NASTEPNY(poprzedni, KAWALEK_NASTEPNY(*aktualny_blok));
 
-    if (poprzedni->nastepny) {
-        poprzedni->nastepny->poprzedni = poprzedni;
+    if (KAWALEK_NASTEPNY(poprzedni)) {
+        KAWALEK_USTAW_POPRZEDNI(KAWALEK_NASTEPNY(poprzedni), poprzedni);
+    } else {
+        memory_manager.ostatni_kawalek = poprzedni;
     }
 
     *aktualny_blok = poprzedni;
 }
 void free_scal_z_nastepnym(struct memory_chunk_t *aktualny_blok) {
-    if (aktualny_blok == NULL || aktualny_blok->nastepny == NULL) {
+    if (aktualny_blok == NULL || znacznik_nastepny(aktualny_blok) == NULL) {
         return;
     }
 
-    struct memory_chunk_t *nastepny_blok = aktualny_blok->nastepny;
+    // Wchłaniany blok znika z koszy i z indeksu
+    struct memory_chunk_t *nastepny_blok = znacznik_nastepny(aktualny_blok);
+    kosze_usun(nastepny_blok);
+    indeks_usun(nastepny_blok);
     aktualny_blok->wielkosc += nastepny_blok->wielkosc + WIELKOSC_CHUNK;
-    aktualny_blok->nastepny = nastepny_blok->nastepny;
+    KAWALEK_USTAW_NASTEPNY(aktualny_blok, KAWALEK_NASTEPNY(nastepny_blok));
 
-    if (nastepny_blok->nastepny != NULL) {
-        nastepny_blok->nastepny->poprzedni = aktualny_blok;
+    if (KAWALEK_NASTEPNY(nastepny_blok) != NULL) {
+        KAWALEK_USTAW_POPRZEDNI(KAWALEK_NASTEPNY(nastepny_blok), aktualny_blok);
+    } else {
+        memory_manager.ostatni_kawalek = aktualny_blok;
     }
 }
 
-size_t heap_get_largest_used_block_size(void) {
-    if (!memory_manager.poczatek || !memory_manager.pierwszy_kawalek || heap_validate() != 0) {
-        return 0;
+int rozmiar_sprawdzany(void) {
+    // Rozmiar podany przez wywołującego sprawdzany jest tylko w trybach walidacji (i przed pierwszym sprawdzeniem
+    // sterty otwartej z pliku, bo odbudowuje ono indeks adresów)
+    return memory_manager.tryb_walidacji != heap_validation_off || memory_manager.odroczone_sprawdzenie;
+}
+int rozmiar_zgodny(void *blok_pamieci, size_t rozmiar) {
+    // Obiekt slabu mieści się w swojej klasie, a blok pamięci wątku w swojej klasie rozmiaru
+    struct slab_t *slab = slab_znajdz(blok_pamieci);
+    if (slab != NULL) {
+        return rozmiar <= slab->rozmiar_obiektu;
     }
+    struct memory_chunk_t *blok = (struct memory_chunk_t *) ((char *) blok_pamieci - POCZATEK_DANYCH);
+    if (kawalek_wlasciciel(blok) != 0) {
+        return rozmiar <= blok->wielkosc;
+    }
+    return rozmiar == blok->wielkosc;
+}
 
+size_t heap_get_largest_used_block_size(void) {
     size_t ile = 0;
-    for (struct memory_chunk_t *i = memory_manager.pierwszy_kawalek; i; i = i->nastepny) {
-        if (i->czy_wolny == 0) {
-            if (ile < i->wielkosc ) {
+    ZABLOKUJ_STERTE();
+    if (memory_manager.poczatek && (memory_manager.pierwszy_kawalek || memory_manager.duze_bloki) &&
+        walidacja_globalna() == 0) {
+        for (struct memory_chunk_t *i = memory_manager.pierwszy_kawalek; i; i = KAWALEK_NASTEPNY(i)) {
+            // Blok płytowy liczy się rozmiarem zajętych obiektów, a nie całego slabu; bloki w pamięciach
+            // podręcznych wątków są dla programu zwolnione
+            size_t wielkosc = i->rodzaj == RODZAJ_SLAB ? slab_najwiekszy_zajety(i) : i->wielkosc;
+            if (i->czy_wolny == 0 && !kawalek_w_pamieci_watku(i)) {
+                if (ile < wielkosc ) {
+                    ile = wielkosc;
+                }
+            }
+        }
+        for (struct memory_chunk_t *i = memory_manager.duze_bloki; i; i = KAWALEK_NASTEPNY(i)) {
+            if (ile < i->wielkosc) {
                 ile = i->wielkosc;
             }
         }
     }
+    ODBLOKUJ_STERTE();
     return ile;
 }
+int heap_stats(struct heap_stats_t *stats) {
+    if (stats == NULL) {
+        return -1;
+    }
+    *stats = (struct heap_stats_t) {0};
+
+    ZABLOKUJ_STERTE();
+    if (memory_manager.poczatek == NULL) {
+        ODBLOKUJ_STERTE();
+        return -1;
+    }
+
+    // Wszystko wynika z liczników - sterta poza nagłówkami i wyrównaniem początku to obszary zajęte i wolne
+    struct statystyki_t *statystyki = &memory_manager.statystyki;
+    size_t wyrownanie_poczatku = memory_manager.pierwszy_kawalek != NULL
+                                 ? (size_t) ((char *) memory_manager.pierwszy_kawalek - (char *) memory_manager.poczatek)
+                                 : memory_manager.wielkosc_pamieci;
+    stats->heap_size = memory_manager.wielkosc_pamieci;
+    stats->bytes_free = statystyki->wolne_bajty;
+    stats->bytes_in_use = memory_manager.wielkosc_pamieci - wyrownanie_poczatku -
+                          statystyki->bloki * WIELKOSC_CHUNK - statystyki->wolne_bajty;
+    stats->free_chunks = statystyki->wolne_bloki;
+    stats->used_chunks = statystyki->bloki - statystyki->wolne_bloki;
+    stats->largest_free_block = kosze_najwiekszy_wolny();
+    stats->mmap_blocks = statystyki->bloki_mmap;
+    stats->mmap_bytes = statystyki->bajty_mmap;
+    stats->sbrk_calls = statystyki->wywolania_sbrk;
+    stats->realloc_in_place = statystyki->realloc_w_miejscu;
+    stats->realloc_moved = statystyki->realloc_przeniesione;
+    for (size_t i = 0; i < HEAP_STATS_CLASSES; i++) {
+        stats->allocations[i] = statystyki->przydzialy[i];
+    }
+#ifdef HEAP_THREAD_SAFE
+    pamiec_watku_zlicz_przydzialy(stats->allocations);
+#endif
+#ifdef HEAP_STATS_LATENCY
+    for (size_t i = 0; i < HEAP_STATS_LATENCY_BUCKETS; i++) {
+        stats->malloc_latency[i] = statystyki->czas_malloc[i];
+        stats->free_latency[i] = statystyki->czas_free[i];
+        stats->realloc_latency[i] = statystyki->czas_realloc[i];
+    }
+#endif
+    ODBLOKUJ_STERTE();
+    return 0;
+}
 enum pointer_type_t get_pointer_type(const void *const wskaznik) {
+    ZABLOKUJ_STERTE();
+    enum pointer_type_t typ = wskaznik_okresl_typ(wskaznik);
+    ODBLOKUJ_STERTE();
+    return typ;
+}
+enum pointer_type_t wskaznik_okresl_typ(const void *wskaznik) {
     if (wskaznik == NULL) {
         return pointer_null;
     }
-    if (memory_manager.pierwszy_kawalek == NULL) {
+    if (memory_manager.pierwszy_kawalek == NULL && memory_manager.duze_bloki == NULL) {
         return pointer_unallocated;
     }
-    if (heap_validate() != 0) {
+    if (walidacja_globalna() != 0) {
+        return pointer_heap_corrupted;
+    }
+
+    struct memory_chunk_t *biezacy;
+    if (sterta_obejmuje(wskaznik)) {
+        // Odszukanie bloku, w którego obszarze leży wskaźnik - przez indeks, a bez niego przez listę
+        biezacy = indeks_znajdz(wskaznik);
+        if (biezacy == NULL) {
+            biezacy = memory_manager.pierwszy_kawalek;
+            while (KAWALEK_NASTEPNY(biezacy) != NULL && (char *) wskaznik >= (char *) KAWALEK_NASTEPNY(biezacy)) {
+                biezacy = KAWALEK_NASTEPNY(biezacy);
+            }
+        }
+    } else {
+        // Bloki mapowane leżą poza stertą, ale mają ten sam układ nagłówka, płotków i danych
+        biezacy = mmap_znajdz(wskaznik);
+        if (biezacy == NULL) {
+            return pointer_unallocated;
+        }
+    }
+    if (walidacja_lokalna(biezacy) != 0) {
         return pointer_heap_corrupted;
     }
 
-    for (struct memory_chunk_t *biezacy = memory_manager.pierwszy_kawalek; biezacy != NULL; biezacy = biezacy->nastepny) {
-        char *podstawa = (char *) biezacy;
-        char *koniec_czesci = podstawa + WIELKOSC_CHUNK;
-        char *koniec_plotka = koniec_czesci + 4;
-        char *koniec_danych = koniec_plotka + biezacy->wielkosc;
-        char *koniec_bloku = koniec_danych + 4;
+    // Wolny blok obejmuje cały swój obszar danych, bez płotków; blok w pamięci podręcznej wątku jest zwolniony
+    if (biezacy->czy_wolny || kawalek_w_pamieci_watku(biezacy)) {
+        return pointer_unallocated;
+    }
+
+    char *podstawa = (char *) biezacy;
+    char *koniec_czesci = podstawa + WIELKOSC_CHUNK;
+    char *koniec_plotka = koniec_czesci + PLOTEK_PRZED;
+    char *koniec_danych = koniec_plotka + biezacy->wielkosc;
+    char *koniec_bloku = koniec_danych + PLOTEK_ZA;
+
+    // Dane bloku płytowego klasyfikuje jego slab
+    if (biezacy->rodzaj == RODZAJ_SLAB && wskaznik >= (void *) koniec_plotka && wskaznik < (void *) koniec_danych) {
+        return slab_okresl_typ((struct slab_t *) koniec_plotka, wskaznik);
+    }
+
+    if (wskaznik < (void *) koniec_czesci) {
+        return pointer_control_block;
+    }
+    if (wskaznik < (void *) koniec_plotka) {
+        return pointer_inside_fences;
+    }
+    if (wskaznik == (void *) koniec_plotka) {
+        return pointer_valid;
+    }
+    if (wskaznik < (void *) koniec_danych) {
+        return pointer_inside_data_block;
+    }
+    if (wskaznik < (void *) koniec_bloku) {
+        return pointer_inside_fences;
+    }
+    return pointer_unallocated;
+}
+int oblicz_checksuma(struct memory_chunk_t *memory_block) {
+    // Weryfikacja wskaźników
+    if (!memory_manager.poczatek || !memory_block) {
+        return 0;
+    }
+
+    // Kopia nagłówka składana pole po polu z wyzerowanym właścicielem i sumą - bajt właściciela zmienia się
+    // bez blokady sterty, więc nie jest nawet odczytywany
+    struct memory_chunk_t naglowek;
+    memset(&naglowek, 0, sizeof(naglowek));
+    naglowek.poprzedni_przesuniecie = memory_block->poprzedni_przesuniecie;
+    naglowek.nastepny_przesuniecie = memory_block->nastepny_przesuniecie;
+    naglowek.wielkosc = memory_block->wielkosc;
+    naglowek.czy_wolny = memory_block->czy_wolny;
+    naglowek.poprzedni_wolny = memory_block->poprzedni_wolny;
+    naglowek.rodzaj = memory_block->rodzaj;
+    const unsigned char *metadane = (const unsigned char *) &naglowek;
+#ifdef HEAP_COMPACT_HEADER
+    // Zwarty nagłówek sumowany jest w całości
+    size_t dlugosc = sizeof(naglowek);
+#else
+    size_t dlugosc = offsetof(struct memory_chunk_t, checksuma);
+#endif
+
+    // Sumowanie metadanych słowami 32-bitowymi z rotacją - zmiana dowolnego bajtu (lub zamiana słów) zmienia wynik
+    uint32_t suma_kontrolna = 0;
+    for (size_t i = 0; i + sizeof(uint32_t) <= dlugosc; i += sizeof(uint32_t)) {
+        uint32_t slowo;
+        memcpy(&slowo, metadane + i, sizeof(slowo));
+        suma_kontrolna = ((suma_kontrolna << 5) | (suma_kontrolna >> 27)) + slowo;
+    }
+
+#ifdef HEAP_COMPACT_HEADER
+    // Powiązania bloku mapowanego leżą przed nagłówkiem, ale także są chronione sumą
+    if (memory_block->rodzaj == RODZAJ_MMAP) {
+        const unsigned char *powiazania = (const unsigned char *) memory_block - PRZEDROSTEK_MMAP;
+        for (size_t i = 0; i < PRZEDROSTEK_MMAP; i += sizeof(uint32_t)) {
+            uint32_t slowo;
+            memcpy(&slowo, powiazania + i, sizeof(slowo));
+            suma_kontrolna = ((suma_kontrolna << 5) | (suma_kontrolna >> 27)) + slowo;
+        }
+    }
+
+    // Suma złożona do szerokości pola w nagłówku
+    suma_kontrolna ^= suma_kontrolna >> BITY_SUMY_KONTROLNEJ;
+    return (int) (suma_kontrolna & ((1u << BITY_SUMY_KONTROLNEJ) - 1));
+#else
+    return (int) suma_kontrolna;
+#endif
+}
+size_t obszar_bloku(struct memory_chunk_t *blok) {
+    // Blok rozciąga się do początku następnego bloku, a ostatni do końca sterty
+    char *koniec = KAWALEK_NASTEPNY(blok) ? (char *) KAWALEK_NASTEPNY(blok)
+                                  : (char *) memory_manager.poczatek + memory_manager.wielkosc_pamieci;
+    return (size_t) (koniec - (char *) blok) - WIELKOSC_CHUNK;
+}
+intptr_t przesuniecie_wzgledne(const void *od, const void *cel) {
+    // Powiązania wewnątrz sterty nie zależą od adresu, pod którym leży (0 oznacza NULL - nic nie wskazuje na siebie)
+    return cel != NULL ? (intptr_t) ((uintptr_t) cel - (uintptr_t) od) : 0;
+}
+void *adres_wzgledny(const void *od, intptr_t przesuniecie) {
+    return przesuniecie != 0 ? (void *) ((uintptr_t) od + (uintptr_t) przesuniecie) : NULL;
+}
+#ifdef HEAP_COMPACT_HEADER
+struct memory_chunk_t *kawalek_z_przesuniecia(uint32_t przesuniecie) {
+    // Przesunięcia liczone są od wyrównanego w dół początku sterty (bloki leżą pod adresami wyrównanymi do WYROWNANIE)
+    if (przesuniecie == 0) {
+        return NULL;
+    }
+    uintptr_t baza = (uintptr_t) memory_manager.poczatek & ~(uintptr_t) (WYROWNANIE - 1);
+    return (struct memory_chunk_t *) (baza + (uintptr_t) (przesuniecie - 1) * WYROWNANIE);
+}
+uint32_t kawalek_przesuniecie(const struct memory_chunk_t *blok) {
+    if (blok == NULL) {
+        return 0;
+    }
+    uintptr_t baza = (uintptr_t) memory_manager.poczatek & ~(uintptr_t) (WYROWNANIE - 1);
+    return (uint32_t) (((uintptr_t) blok - baza) / WYROWNANIE + 1);
+}
+struct powiazania_mmap_t *kawalek_powiazania_mmap(const struct memory_chunk_t *blok) {
+    // Powiązania leżą w odwzorowaniu tuż przed nagłówkiem bloku mapowanego
+    return (struct powiazania_mmap_t *) ((uintptr_t) blok - PRZEDROSTEK_MMAP);
+}
+struct memory_chunk_t *kawalek_poprzedni(const struct memory_chunk_t *blok) {
+    if (blok->rodzaj == RODZAJ_MMAP) {
+        return kawalek_powiazania_mmap(blok)->poprzedni;
+    }
+    return kawalek_z_przesuniecia(blok->poprzedni_przesuniecie);
+}
+struct memory_chunk_t *kawalek_nastepny(const struct memory_chunk_t *blok) {
+    if (blok->rodzaj == RODZAJ_MMAP) {
+        return kawalek_powiazania_mmap(blok)->nastepny;
+    }
+    return kawalek_z_przesuniecia(blok->nastepny_przesuniecie);
+}
+void kawalek_ustaw_poprzedni(struct memory_chunk_t *blok, struct memory_chunk_t *poprzedni) {
+    if (blok->rodzaj == RODZAJ_MMAP) {
+        kawalek_powiazania_mmap(blok)->poprzedni = poprzedni;
+    } else {
+        blok->poprzedni_przesuniecie = kawalek_przesuniecie(poprzedni);
+    }
+}
+void kawalek_ustaw_nastepny(struct memory_chunk_t *blok, struct memory_chunk_t *nastepny) {
+    if (blok->rodzaj == RODZAJ_MMAP) {
+        kawalek_powiazania_mmap(blok)->nastepny = nastepny;
+    } else {
+        blok->nastepny_przesuniecie = kawalek_przesuniecie(nastepny);
+    }
+}
+#else
+struct memory_chunk_t *kawalek_poprzedni(const struct memory_chunk_t *blok) {
+    return adres_wzgledny(blok, blok->poprzedni_przesuniecie);
+}
+struct memory_chunk_t *kawalek_nastepny(const struct memory_chunk_t *blok) {
+    return adres_wzgledny(blok, blok->nastepny_przesuniecie);
+}
+void kawalek_ustaw_poprzedni(struct memory_chunk_t *blok, struct memory_chunk_t *poprzedni) {
+    blok->poprzedni_przesuniecie = przesuniecie_wzgledne(blok, poprzedni);
+}
+void kawalek_ustaw_nastepny(struct memory_chunk_t *blok, struct memory_chunk_t *nastepny) {
+    blok->nastepny_przesuniecie = przesuniecie_wzgledne(blok, nastepny);
+}
+#endif
+uint8_t kawalek_wlasciciel(const struct memory_chunk_t *blok) {
+    // Właściciela zmienia bez blokady zwolnienie do pamięci podręcznej wątku i przydział z niej
+    return __atomic_load_n(&blok->wlasciciel, __ATOMIC_ACQUIRE);
+}
+int kawalek_w_pamieci_watku(const struct memory_chunk_t *blok) {
+    // Blok leżący w pamięci podręcznej wątku jest dla programu zwolniony
+    return (kawalek_wlasciciel(blok) & WLASCICIEL_W_PAMIECI) != 0;
+}
+void *wywolaj_sbrk(intptr_t zmiana) {
+    // Wszystkie zmiany wielkości sterty przechodzą tędy, by dało się je policzyć
+    memory_manager.statystyki.wywolania_sbrk++;
+#ifdef HEAP_COMPACT_HEADER
+    // Wielkości w zwartym nagłówku mieszczą najwyżej NAJWIEKSZA_STERTA bajtów
+    if (zmiana > 0 && (size_t) zmiana > NAJWIEKSZA_STERTA - memory_manager.wielkosc_pamieci) {
+        return (void *) -1;
+    }
+#endif
+    char *poprzedni_koniec = sterta_sbrk(zmiana);
+    if (poprzedni_koniec == (void *) -1) {
+        return poprzedni_koniec;
+    }
+
+    // Oddanej pamięci custom_sbrk nie musi zerować - granica czystej pamięci przechodzi za dotychczasowy koniec sterty
+    if (zmiana < 0 && memory_manager.obszar.poczatek == NULL) {
+        calloc_oznacz_zapisane(poprzedni_koniec);
+    }
+    return poprzedni_koniec;
+}
+
+struct memory_manager_t *sterta_wybierz(heap_t *sterta) {
+    // Bieżąca sterta wątku zmienia się na czas jednego wywołania heap_*_in (NULL oznacza stertę główną)
+    struct memory_manager_t *poprzednia = biezaca_sterta;
+    biezaca_sterta = sterta != NULL ? sterta : &glowna_sterta;
+    return poprzednia;
+}
+int sterta_obejmuje(const void *wskaznik) {
+    // Bloki mapowane leżą poza obszarem sterty, więc wskaźnik z tego obszaru nie wymaga przeszukania ich listy
+    return memory_manager.pierwszy_kawalek != NULL && (const char *) wskaznik >= (char *) memory_manager.pierwszy_kawalek &&
+           (const char *) wskaznik < (char *) memory_manager.poczatek + memory_manager.wielkosc_pamieci;
+}
+void *sterta_sbrk(intptr_t zmiana) {
+    struct obszar_sterty_t *obszar = &memory_manager.obszar;
+    if (obszar->poczatek == NULL) {
+        return custom_sbrk(zmiana);
+    }
+
+    // Jak custom_sbrk, lecz w obszarze zarezerwowanym przez heap_create
+    if ((zmiana < 0 && (size_t) -zmiana > obszar->granica) ||
+        (zmiana > 0 && (size_t) zmiana > obszar->pojemnosc - obszar->granica)) {
+        return (void *) -1;
+    }
+    char *poprzednia_granica = obszar->poczatek + obszar->granica;
+    obszar->granica += (size_t) zmiana;
+
+    // Oddane całe strony wracają do systemu, a przy ponownym użyciu są wyzerowane - czysta jest cała pamięć
+    // od pierwszej strony za nowym końcem (wcześniej oddane strony też zostały wyzerowane); strony pliku
+    // zeruje dopiero zwolnienie ich miejsca w pliku
+    if (zmiana < 0) {
+        uintptr_t poczatek_stron = ((uintptr_t) (obszar->poczatek + obszar->granica) + ROZMIAR_STRONY - 1) &
+                                   ~(uintptr_t) (ROZMIAR_STRONY - 1);
+        uintptr_t koniec_stron = ((uintptr_t) poprzednia_granica + ROZMIAR_STRONY - 1) & ~(uintptr_t) (ROZMIAR_STRONY - 1);
+        int wyzerowane = 1;
+        if (poczatek_stron < koniec_stron) {
+            wyzerowane = madvise((void *) poczatek_stron, koniec_stron - poczatek_stron,
+                                 obszar->plik ? MADV_REMOVE : MADV_DONTNEED) == 0;
+        }
+        if (wyzerowane) {
+            obszar->czyste_od = (char *) poczatek_stron;
+        } else if (poprzednia_granica > obszar->czyste_od) {
+            obszar->czyste_od = poprzednia_granica;
+        }
+    }
+    return poprzednia_granica;
+}
+void *plik_przesun(void *wskaznik, intptr_t roznica) {
+    return wskaznik != NULL ? (void *) ((uintptr_t) wskaznik + (uintptr_t) roznica) : NULL;
+}
+void plik_przenies(intptr_t roznica) {
+    // Powiązania bloków, koszy i slabów są względne - przesuwane są tylko wskaźniki menedżera (jest ich stała liczba)
+    memory_manager.obszar.poczatek = plik_przesun(memory_manager.obszar.poczatek, roznica);
+    memory_manager.obszar.czyste_od = plik_przesun(memory_manager.obszar.czyste_od, roznica);
+    memory_manager.poczatek = plik_przesun(memory_manager.poczatek, roznica);
+    memory_manager.pierwszy_kawalek = plik_przesun(memory_manager.pierwszy_kawalek, roznica);
+    memory_manager.ostatni_kawalek = plik_przesun(memory_manager.ostatni_kawalek, roznica);
+    for (size_t i = 0; i < LICZBA_KOSZY; i++) {
+        memory_manager.kosze[i] = plik_przesun(memory_manager.kosze[i], roznica);
+    }
+    for (size_t i = 0; i < KLASY_SLABOW; i++) {
+        memory_manager.slaby[i] = plik_przesun(memory_manager.slaby[i], roznica);
+    }
+
+    // Indeks adresów i funkcja zgłaszająca uszkodzenia należały do poprzedniego procesu; indeks zostanie odbudowany
+    // razem z pełnym sprawdzeniem sterty
+    memory_manager.wedrowny = NULL;
+    memory_manager.skaner = NULL;
+    memory_manager.duze_bloki = NULL;
+    memory_manager.indeks_stron = NULL;
+    memory_manager.indeks_mapa = NULL;
+    memory_manager.indeks_podsumowanie = NULL;
+    memory_manager.strony_slabow = NULL;
+    memory_manager.bloki_podreczne = NULL;
+    memory_manager.zgloszenie = NULL;
+    memory_manager.zgloszenie_argument = NULL;
+    memory_manager.odroczone_sprawdzenie = 1;
+}
+int plik_dokoncz_otwarcie(void) {
+    // Pełna walidacja, a po niej indeks adresów budowany przejściem listy (indeks_dodaj liczy bloki od nowa)
+    int wynik = walidacja_pelna();
+    if (wynik != 0) {
+        return wynik;
+    }
+    indeks_utworz();
+    memory_manager.statystyki.bloki = 0;
+    for (struct memory_chunk_t *blok = memory_manager.pierwszy_kawalek; blok != NULL; blok = KAWALEK_NASTEPNY(blok)) {
+        indeks_dodaj(blok);
+        if (blok->rodzaj == RODZAJ_SLAB) {
+            indeks_oznacz_slab((struct slab_t *) ((char *) blok + POCZATEK_DANYCH), 1);
+        }
+    }
+    memory_manager.odroczone_sprawdzenie = 0;
+    return 0;
+}
+
+char **sterta_czysta_pamiec(void) {
+    // Granica czystej pamięci należy do źródła pamięci sterty - custom_sbrk albo własnego obszaru
+    return memory_manager.obszar.poczatek != NULL ? &memory_manager.obszar.czyste_od : &czysta_pamiec_od;
+}
+
+size_t statystyki_klasa(size_t rozmiar) {
+    // Klasą rozmiaru jest numer najstarszego ustawionego bitu
+    size_t klasa = 63 - (size_t) __builtin_clzll((unsigned long long) rozmiar);
+    return klasa < HEAP_STATS_CLASSES ? klasa : HEAP_STATS_CLASSES - 1;
+}
+void statystyki_przydzial(size_t rozmiar) {
+    memory_manager.statystyki.przydzialy[statystyki_klasa(rozmiar)]++;
+}
+#ifdef HEAP_STATS_LATENCY
+uint64_t statystyki_czas(void) {
+    // Licznik cykli procesora tam, gdzie jest dostępny, w pozostałych przypadkach nanosekundy zegara monotonicznego
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec czas;
+    clock_gettime(CLOCK_MONOTONIC, &czas);
+    return (uint64_t) czas.tv_sec * 1000000000u + (uint64_t) czas.tv_nsec;
+#endif
+}
+void statystyki_zapisz_czas(licznik_czasu_t *histogram, uint64_t cykle) {
+    // Przedział i obejmuje czasy od 2^i do 2^(i+1)-1 cykli
+    size_t przedzial = cykle == 0 ? 0 : 63 - (size_t) __builtin_clzll((unsigned long long) cykle);
+    histogram[przedzial < HEAP_STATS_LATENCY_BUCKETS ? przedzial : HEAP_STATS_LATENCY_BUCKETS - 1]++;
+}
+#endif
+
+size_t *znacznik_stopka(struct memory_chunk_t *blok) {
+    // Stopka zajmuje ostatnie bajty obszaru wolnego bloku
+    return (size_t *) ((char *) blok + WIELKOSC_CHUNK + blok->wielkosc - sizeof(size_t));
+}
+struct memory_chunk_t *znacznik_nastepny(struct memory_chunk_t *blok) {
+    // Wielkość wolnego bloku to cały jego obszar, więc następny blok leży tuż za nim (o ile nie jest to koniec sterty)
+    char *nastepny = (char *) blok + WIELKOSC_CHUNK + (blok->czy_wolny ? blok->wielkosc : obszar_bloku(blok));
+    if (nastepny >= (char *) memory_manager.poczatek + memory_manager.wielkosc_pamieci) {
+        return NULL;
+    }
+    return (struct memory_chunk_t *) nastepny;
+}
+struct memory_chunk_t *znacznik_poprzedni_wolny(struct memory_chunk_t *blok) {
+    // Flaga w nagłówku mówi, czy tuż przed blokiem leży stopka wolnego poprzednika
+    if (!blok->poprzedni_wolny) {
+        return NULL;
+    }
+    size_t wielkosc_poprzedniego = *((size_t *) blok - 1);
+    return (struct memory_chunk_t *) ((char *) blok - wielkosc_poprzedniego - WIELKOSC_CHUNK);
+}
+void znacznik_ustaw(struct memory_chunk_t *blok, int wolny) {
+    if (wolny) {
+        *znacznik_stopka(blok) = blok->wielkosc;
+    }
+
+    // Zmiana flagi w nagłówku następnika wymaga przeliczenia jego sumy kontrolnej
+    struct memory_chunk_t *nastepny = znacznik_nastepny(blok);
+    if (nastepny != NULL && nastepny->poprzedni_wolny != (uint8_t) wolny) {
+        nastepny->poprzedni_wolny = (uint8_t) wolny;
+        nastepny->checksuma = oblicz_checksuma(nastepny);
+    }
+}
+
+struct memory_chunk_t *rozmieszczenie_znajdz(size_t potrzeba) {
+    // Polityki rozmieszczenia - indeksowane wartościami heap_placement_t
+    static struct memory_chunk_t *(*const polityki[])(size_t) = {
+            [heap_placement_good_fit] = kosze_znajdz,
+            [heap_placement_first_fit] = kosze_znajdz_pierwszy,
+            [heap_placement_next_fit] = rozmieszczenie_nastepne_dopasowanie,
+            [heap_placement_best_fit] = kosze_znajdz_najlepszy
+    };
+    return polityki[memory_manager.polityka_rozmieszczenia](potrzeba);
+}
+struct memory_chunk_t *rozmieszczenie_nastepne_dopasowanie(size_t potrzeba) {
+    // Przejście listy bloków od miejsca ostatniego trafienia, z powrotem na początek sterty po dojściu do końca
+    struct memory_chunk_t *start = memory_manager.wedrowny ? memory_manager.wedrowny : memory_manager.pierwszy_kawalek;
+    struct memory_chunk_t *blok = start;
+    while (blok != NULL) {
+        if (blok->czy_wolny && blok->wielkosc >= potrzeba) {
+            memory_manager.wedrowny = blok;
+            return blok;
+        }
+        blok = KAWALEK_NASTEPNY(blok) ? KAWALEK_NASTEPNY(blok) : memory_manager.pierwszy_kawalek;
+        if (blok == start) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+size_t kosz_indeks(size_t wielkosc) {
+    // Pierwszy poziom to potęga dwójki, drugi dzieli ją na cztery równe podprzedziały
+    size_t poziom = 63 - (size_t) __builtin_clzll((unsigned long long) wielkosc);
+    size_t podprzedzial = (wielkosc >> (poziom - 2)) & 3;
+    return poziom * 4 + podprzedzial;
+}
+struct wolny_kawalek_t *kosz_powiazania(struct memory_chunk_t *blok) {
+    return (struct wolny_kawalek_t *) ((char *) blok + WIELKOSC_CHUNK);
+}
+struct memory_chunk_t *kosz_poprzedni(struct memory_chunk_t *blok) {
+    return adres_wzgledny(blok, kosz_powiazania(blok)->poprzedni_wolny);
+}
+struct memory_chunk_t *kosz_nastepny(struct memory_chunk_t *blok) {
+    return adres_wzgledny(blok, kosz_powiazania(blok)->nastepny_wolny);
+}
+void kosze_wstaw(struct memory_chunk_t *blok) {
+    size_t indeks = kosz_indeks(blok->wielkosc);
+    struct wolny_kawalek_t *powiazania = kosz_powiazania(blok);
+
+    // Wstawienie na początek listy kosza
+    struct memory_chunk_t *nastepny = memory_manager.kosze[indeks];
+    powiazania->poprzedni_wolny = 0;
+    powiazania->nastepny_wolny = przesuniecie_wzgledne(blok, nastepny);
+    if (nastepny) {
+        kosz_powiazania(nastepny)->poprzedni_wolny = przesuniecie_wzgledne(nastepny, blok);
+    }
+    memory_manager.kosze[indeks] = blok;
+
+    // Oznaczenie kosza jako niepustego w mapie zajętości
+    memory_manager.mapa_koszy[indeks / 64] |= (uint64_t) 1 << (indeks % 64);
+
+    // Blok w koszu jest wolny - dostaje stopkę, a następnik flagę wolnego poprzednika
+    znacznik_ustaw(blok, 1);
+    memory_manager.statystyki.wolne_bloki++;
+    memory_manager.statystyki.wolne_bajty += blok->wielkosc;
+}
+void kosze_usun(struct memory_chunk_t *blok) {
+    size_t indeks = kosz_indeks(blok->wielkosc);
+    znacznik_ustaw(blok, 0);
+    memory_manager.statystyki.wolne_bloki--;
+    memory_manager.statystyki.wolne_bajty -= blok->wielkosc;
+
+    // Wypięcie bloku z dwukierunkowej listy kosza
+    struct memory_chunk_t *poprzedni = kosz_poprzedni(blok);
+    struct memory_chunk_t *nastepny = kosz_nastepny(blok);
+    if (poprzedni) {
+        kosz_powiazania(poprzedni)->nastepny_wolny = przesuniecie_wzgledne(poprzedni, nastepny);
+    } else {
+        memory_manager.kosze[indeks] = nastepny;
+    }
+    if (nastepny) {
+        kosz_powiazania(nastepny)->poprzedni_wolny = przesuniecie_wzgledne(nastepny, poprzedni);
+    }
+
+    // Pusty kosz znika z mapy zajętości
+    if (memory_manager.kosze[indeks] == NULL) {
+        memory_manager.mapa_koszy[indeks / 64] &= ~((uint64_t) 1 << (indeks % 64));
+    }
+}
+size_t kosze_nastepny_niepusty(size_t start) {
+    // Pierwszy niepusty kosz od wskazanego indeksu, odczytany z mapy zajętości (LICZBA_KOSZY, gdy brak)
+    for (size_t slowo = start / 64; slowo < LICZBA_KOSZY / 64; slowo++) {
+        uint64_t maska = memory_manager.mapa_koszy[slowo];
+        if (slowo == start / 64) {
+            maska &= ~(uint64_t) 0 << (start % 64);
+        }
+        if (maska) {
+            return slowo * 64 + (size_t) __builtin_ctzll(maska);
+        }
+    }
+    return LICZBA_KOSZY;
+}
+struct memory_chunk_t *kosze_znajdz(size_t potrzeba) {
+    // Zaokrąglenie w górę do granicy kosza - każdy blok z kolejnych koszy na pewno się zmieści
+    size_t indeks = kosz_indeks(potrzeba);
+    size_t poziom = indeks / 4;
+    size_t dolna_granica = (4 + indeks % 4) << (poziom - 2);
+    size_t kosz = kosze_nastepny_niepusty(dolna_granica < potrzeba ? indeks + 1 : indeks);
+    if (kosz < LICZBA_KOSZY) {
+        return memory_manager.kosze[kosz];
+    }
 
-        if (biezacy->czy_wolny == 0) {
-            if (wskaznik < (void *) koniec_czesci) {
-                return pointer_control_block;
+    // W ostateczności przejrzenie kosza, do którego należy sam rozmiar
+    for (struct memory_chunk_t *blok = memory_manager.kosze[indeks]; blok; blok = kosz_nastepny(blok)) {
+        if (blok->wielkosc >= potrzeba) {
+            return blok;
+        }
+    }
+    return NULL;
+}
+struct memory_chunk_t *kosze_znajdz_pierwszy(size_t potrzeba) {
+    // Pierwszy mieszczący się blok z kosza samego rozmiaru, a gdy go brak - pierwszy blok kolejnego niepustego kosza
+    size_t indeks = kosz_indeks(potrzeba);
+    for (struct memory_chunk_t *blok = memory_manager.kosze[indeks]; blok; blok = kosz_nastepny(blok)) {
+        if (blok->wielkosc >= potrzeba) {
+            return blok;
+        }
+    }
+    size_t kosz = kosze_nastepny_niepusty(indeks + 1);
+    return kosz < LICZBA_KOSZY ? memory_manager.kosze[kosz] : NULL;
+}
+struct memory_chunk_t *kosze_znajdz_najlepszy(size_t potrzeba) {
+    // Kosze obejmują rosnące przedziały, więc najmniejszy mieszczący się blok leży w pierwszym koszu, który go ma
+    size_t kosz = kosz_indeks(potrzeba);
+    while (kosz < LICZBA_KOSZY) {
+        struct memory_chunk_t *najlepszy = NULL;
+        for (struct memory_chunk_t *blok = memory_manager.kosze[kosz]; blok; blok = kosz_nastepny(blok)) {
+            if (blok->wielkosc >= potrzeba && (najlepszy == NULL || blok->wielkosc < najlepszy->wielkosc)) {
+                najlepszy = blok;
+                if (blok->wielkosc == potrzeba) {
+                    break;
+                }
             }
-            if (wskaznik < (void *) koniec_plotka) {
-                return pointer_inside_fences;
+        }
+        if (najlepszy != NULL) {
+            return najlepszy;
+        }
+        kosz = kosze_nastepny_niepusty(kosz + 1);
+    }
+    return NULL;
+}
+size_t kosze_najwiekszy_wolny(void) {
+    // Najwyższy niepusty kosz z mapy zajętości - przeglądane są tylko bloki tego jednego kosza
+    for (size_t slowo = LICZBA_KOSZY / 64; slowo-- > 0;) {
+        if (memory_manager.mapa_koszy[slowo]) {
+            size_t indeks = slowo * 64 + 63 - (size_t) __builtin_clzll(memory_manager.mapa_koszy[slowo]);
+            size_t najwiekszy = 0;
+            for (struct memory_chunk_t *blok = memory_manager.kosze[indeks]; blok != NULL;
+                 blok = kosz_nastepny(blok)) {
+                if (najwiekszy < blok->wielkosc) {
+                    najwiekszy = blok->wielkosc;
+                }
             }
-            if (wskaznik == (void *) koniec_plotka) {
-                return pointer_valid;
+            return najwiekszy;
+        }
+    }
+    return 0;
+}
+
+size_t heap_malloc_batch(size_t n, const size_t *sizes, void **out) {
+    if (out == NULL || (n != 0 && sizes == NULL)) {
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        out[i] = NULL;
+    }
+
+    size_t przydzielone = 0;
+    ZABLOKUJ_STERTE();
+    if (memory_manager.poczatek != NULL && (memory_manager.pierwszy_kawalek == NULL || walidacja_globalna() == 0)) {
+        // Jedna walidacja na całą porcję; żądania bez miejsca w koszach czekają na wspólne rozszerzenie sterty
+        size_t zalegly_obszar = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (sizes[i] == 0) {
+                continue;
             }
-            if (wskaznik < (void *) koniec_danych) {
-                return pointer_inside_data_block;
+            if (!malloc_zwykly_blok(sizes[i])) {
+                out[i] = malloc_przydziel(sizes[i]);
+                continue;
             }
-            if (wskaznik < (void *) koniec_bloku) {
-                return pointer_inside_fences;
+            struct memory_chunk_t *blok = rozmieszczenie_znajdz(malloc_wymagany_obszar(sizes[i]));
+            if (blok == NULL) {
+                zalegly_obszar += WIELKOSC_CHUNK + malloc_wymagany_obszar(sizes[i]);
+            } else if (walidacja_lokalna(blok) == 0) {
+                out[i] = malloc_przydziel_z_kosza(blok, sizes[i]);
+            } else {
+                // Uszkodzona sterta - pozostałe żądania nie są obsługiwane
+                zalegly_obszar = 0;
+                break;
             }
-            if (biezacy->nastepny != NULL) {
-                char *nastepny_blok = (char *) biezacy->nastepny;
-                if (nastepny_blok > (char *) wskaznik && wskaznik >= (void *) koniec_bloku) {
-                    return pointer_unallocated;
+        }
+        if (zalegly_obszar != 0) {
+            wsadowo_przydziel_zalegle(n, sizes, out, zalegly_obszar - WIELKOSC_CHUNK);
+        }
+
+        // Każdy obiekt porcji jest w śladzie osobnym zdarzeniem malloc
+        int slad = slad_aktywny();
+        for (size_t i = 0; i < n; i++) {
+            if (out[i] != NULL) {
+                statystyki_przydzial(sizes[i]);
+                przydzielone++;
+                if (slad) {
+                    slad_zapisz(heap_trace_malloc, sizes[i], out[i], NULL);
                 }
             }
-        } else {
-            if (wskaznik < (void *) koniec_danych) {
-                return pointer_unallocated;
-            }
         }
     }
-    return pointer_unallocated;
+    ODBLOKUJ_STERTE();
+    return przydzielone;
 }
-int oblicz_checksuma(struct memory_chunk_t *memory_block) {
-    // Weryfikacja wskaźników
-    if (!memory_manager.poczatek || !memory_manager.pierwszy_kawalek || !memory_block) {
-        return 0;
+void heap_free_batch(void *const *ptrs, size_t n) {
+    if (ptrs == NULL || n == 0) {
+        return;
     }
 
-    int suma_kontrolna = 0;
-    // Użycie wskaźnika do iteracji przez bajty metadanych
-    for (unsigned char *i = (unsigned char *) memory_block;
-         i < (unsigned char *) memory_block + WIELKOSC_CHUNK - 4; i++) {
-        suma_kontrolna += *i;
+    // Porządkowana jest kopia tablicy - mała na stosie, większa w osobnym odwzorowaniu; bez niego bloki są
+    // zwalniane w kolejności wywołującego
+    void *bufor[BUFOR_ZWALNIANIA_WSADOWEGO];
+    void **kolejnosc = bufor;
+    if (n > BUFOR_ZWALNIANIA_WSADOWEGO) {
+        kolejnosc = mmap(NULL, n * sizeof(void *), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (kolejnosc == MAP_FAILED) {
+            kolejnosc = NULL;
+        }
+    }
+
+    ZABLOKUJ_STERTE();
+    if (memory_manager.poczatek != NULL && walidacja_globalna() == 0) {
+        // Zwalnianie w kolejności adresów - sąsiednie bloki scalają się z właśnie zwolnionym poprzednikiem
+        if (kolejnosc != NULL) {
+            memcpy(kolejnosc, ptrs, n * sizeof(void *));
+            qsort(kolejnosc, n, sizeof(void *), wsadowo_porownaj_adresy);
+        }
+
+        // Tak jak heap_free: zdarzenie free, ale tylko dla bloku, który został zwolniony
+        int slad = slad_aktywny();
+        for (size_t i = 0; i < n; i++) {
+            void *wskaznik = kolejnosc != NULL ? kolejnosc[i] : ptrs[i];
+            if (wsadowo_zwolnij(wskaznik) && slad) {
+                slad_zapisz(heap_trace_free, 0, wskaznik, NULL);
+            }
+        }
+
+        // Koniec sterty jest sprawdzany raz, po scaleniu wszystkich bloków
+        przycinanie_automatyczne();
     }
+    ODBLOKUJ_STERTE();
 
-    return suma_kontrolna;
+    if (kolejnosc != NULL && kolejnosc != bufor) {
+        munmap(kolejnosc, n * sizeof(void *));
+    }
+}
+int wsadowo_porownaj_adresy(const void *a, const void *b) {
+    uintptr_t lewy = (uintptr_t) *(void *const *) a;
+    uintptr_t prawy = (uintptr_t) *(void *const *) b;
+    return (lewy > prawy) - (lewy < prawy);
+}
+int wsadowo_zwolnij(void *wskaznik) {
+    // Zwraca 1 tylko wtedy, gdy blok lub obiekt naprawdę został zwolniony
+    if (wskaznik == NULL) {
+        return 0;
+    }
+#ifdef HEAP_THREAD_SAFE
+    int wynik = pamiec_watku_zwolnij(wskaznik);
+    if (wynik != 0) {
+        return wynik > 0;
+    }
+#endif
+    return free_zwolnij_wskaznik(wskaznik);
+}
+void wsadowo_przydziel_zalegle(size_t n, const size_t *rozmiary, void **wyniki, size_t obszar) {
+    // Jedno wywołanie custom_sbrk na wszystkie zaległe żądania, które następnie są kolejno odcinane od początku
+    struct memory_chunk_t *blok = malloc_rozszerz_o_wolny_blok(obszar);
+    if (blok == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < n && blok != NULL; i++) {
+        if (wyniki[i] != NULL || rozmiary[i] == 0 || !malloc_zwykly_blok(rozmiary[i])) {
+            continue;
+        }
+        blok->czy_wolny = 0;
+        struct memory_chunk_t *reszta = podziel_blok(blok, malloc_wymagany_obszar(rozmiary[i]));
+        blok->wielkosc = rozmiary[i];
+        calloc_oznacz_wydany(blok);
+        malloc_inicjalizuj_blok_pamieci(blok);
+        blok->checksuma = oblicz_checksuma(blok);
+        wyniki[i] = (void *) ((char *) blok + POCZATEK_DANYCH);
+        blok = reszta;
+    }
+
+    // Wolny ostatni blok mógł być większy niż potrzeba - nadmiar wraca do koszy
+    if (blok != NULL) {
+        free_zwolnij_blok(blok);
+    }
+}
+
+size_t indeks_rozmiar(void) {
+    // Dla każdej strony sterty: ostatni blok zaczynający się na niej, mapa stron z początkami bloków i jej
+    // podsumowanie, a także znacznik strony zajętej przez slab; w trybie wielowątkowym dochodzi mapa początków
+    // danych bloków należących do pamięci wątków (bit na każde WYROWNANIE bajtów)
+    size_t slowa_mapy = (HEAP_INDEX_PAGES + 63) / 64;
+    size_t slowa_podsumowania = (slowa_mapy + 63) / 64;
+    size_t rozmiar = HEAP_INDEX_PAGES * sizeof(struct memory_chunk_t *) +
+                     (slowa_mapy + slowa_podsumowania) * sizeof(uint64_t) + HEAP_INDEX_PAGES;
+#ifdef HEAP_THREAD_SAFE
+    rozmiar = (rozmiar + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    rozmiar += HEAP_INDEX_PAGES * (ROZMIAR_STRONY / WYROWNANIE / 64) * sizeof(uint64_t);
+#endif
+    return rozmiar;
+}
+void indeks_utworz(void) {
+    // Strony indeksu są rezerwowane leniwie - fizycznie zajmują tylko te, które opisują istniejące bloki
+    void *pamiec = mmap(NULL, indeks_rozmiar(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (pamiec == MAP_FAILED) {
+        return;
+    }
+    size_t slowa_mapy = (HEAP_INDEX_PAGES + 63) / 64;
+    memory_manager.indeks_stron = (struct memory_chunk_t **) pamiec;
+    memory_manager.indeks_mapa = (uint64_t *) (memory_manager.indeks_stron + HEAP_INDEX_PAGES);
+    memory_manager.indeks_podsumowanie = memory_manager.indeks_mapa + slowa_mapy;
+    memory_manager.strony_slabow = (uint8_t *) (memory_manager.indeks_podsumowanie + (slowa_mapy + 63) / 64);
+#ifdef HEAP_THREAD_SAFE
+    uintptr_t mapa_podrecznych = (uintptr_t) (memory_manager.strony_slabow + HEAP_INDEX_PAGES);
+    memory_manager.bloki_podreczne =
+            (uint64_t *) ((mapa_podrecznych + sizeof(uint64_t) - 1) & ~(uintptr_t) (sizeof(uint64_t) - 1));
+#endif
+}
+void indeks_zwolnij(void) {
+    if (memory_manager.indeks_stron != NULL) {
+        munmap(memory_manager.indeks_stron, indeks_rozmiar());
+        memory_manager.indeks_stron = NULL;
+        memory_manager.strony_slabow = NULL;
+        memory_manager.bloki_podreczne = NULL;
+    }
+}
+size_t indeks_strona(const void *wskaznik) {
+    return (size_t) ((const char *) wskaznik - (char *) memory_manager.poczatek) / ROZMIAR_STRONY;
+}
+size_t indeks_strona_slabu(const void *wskaznik) {
+    // Slab zajmuje jedną wyrównaną stronę - numer liczony od strony, na której zaczyna się sterta
+    return (size_t) (((uintptr_t) wskaznik - ((uintptr_t) memory_manager.poczatek & ~(uintptr_t) (ROZMIAR_STRONY - 1))) /
+                     ROZMIAR_STRONY);
+}
+void indeks_oznacz_slab(struct slab_t *slab, uint8_t znacznik) {
+    // Znacznik ustawiany jest po zapisaniu całego nagłówka slabu - odczyt bez blokady widzi gotowy nagłówek
+    size_t strona = indeks_strona_slabu(slab);
+    if (memory_manager.strony_slabow != NULL && strona < HEAP_INDEX_PAGES) {
+        __atomic_store_n(&memory_manager.strony_slabow[strona], znacznik, __ATOMIC_RELEASE);
+    }
+}
+struct slab_t *indeks_slab(const void *wskaznik) {
+    // Slab, na którego stronie leży wskaźnik, odszukany bez blokady sterty i bez odczytu pamięci spoza indeksu
+    if (memory_manager.strony_slabow == NULL || (const char *) wskaznik < (char *) memory_manager.poczatek) {
+        return NULL;
+    }
+    size_t strona = indeks_strona_slabu(wskaznik);
+    if (strona >= HEAP_INDEX_PAGES || !__atomic_load_n(&memory_manager.strony_slabow[strona], __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return (struct slab_t *) ((uintptr_t) wskaznik & ~(uintptr_t) (ROZMIAR_SLABU - 1));
+}
+void indeks_oznacz_podreczny(struct memory_chunk_t *blok, int znacznik) {
+    // Bit ustawiany jest pod blokadą, gdy blok trafia do pamięci wątku, i zdejmowany, zanim do niej wróci
+    if (memory_manager.bloki_podreczne == NULL) {
+        return;
+    }
+    size_t pozycja = (size_t) ((char *) blok + POCZATEK_DANYCH - (char *) memory_manager.poczatek) / WYROWNANIE;
+    uint64_t bit = (uint64_t) 1 << (pozycja % 64);
+    if (znacznik) {
+        __atomic_fetch_or(&memory_manager.bloki_podreczne[pozycja / 64], bit, __ATOMIC_RELEASE);
+    } else {
+        __atomic_fetch_and(&memory_manager.bloki_podreczne[pozycja / 64], ~bit, __ATOMIC_RELEASE);
+    }
+}
+int indeks_podreczny(const void *wskaznik) {
+    // Czy wskaźnik jest początkiem danych bloku pamięci wątku - sprawdzane bez blokady i bez odczytu sterty;
+    // zakres indeksu zastępuje granice sterty, których nie można odczytać bez blokady
+    if (memory_manager.bloki_podreczne == NULL || (uintptr_t) wskaznik % WYROWNANIE != 0 ||
+        (const char *) wskaznik < (char *) memory_manager.poczatek + POCZATEK_DANYCH) {
+        return 0;
+    }
+    size_t pozycja = (size_t) ((const char *) wskaznik - (char *) memory_manager.poczatek) / WYROWNANIE;
+    if (pozycja >= HEAP_INDEX_PAGES * (ROZMIAR_STRONY / WYROWNANIE)) {
+        return 0;
+    }
+    return (__atomic_load_n(&memory_manager.bloki_podreczne[pozycja / 64], __ATOMIC_ACQUIRE) &
+            ((uint64_t) 1 << (pozycja % 64))) != 0;
+}
+void indeks_dodaj(struct memory_chunk_t *blok) {
+    // Każdy powstający blok sterty trafia do indeksu, więc tu liczone są też wszystkie bloki
+    memory_manager.statystyki.bloki++;
+    size_t strona = indeks_strona(blok);
+    if (memory_manager.indeks_stron == NULL || strona >= HEAP_INDEX_PAGES) {
+        return;
+    }
+
+    // Strona pamięta tylko ostatni zaczynający się na niej blok - wcześniejsze osiąga się przez poprzedni
+    struct memory_chunk_t **ostatni_na_stronie = &memory_manager.indeks_stron[strona];
+    if (*ostatni_na_stronie == NULL || (char *) *ostatni_na_stronie < (char *) blok) {
+        *ostatni_na_stronie = blok;
+    }
+    memory_manager.indeks_mapa[strona / 64] |= (uint64_t) 1 << (strona % 64);
+    memory_manager.indeks_podsumowanie[strona / 4096] |= (uint64_t) 1 << (strona / 64 % 64);
+}
+void indeks_usun(struct memory_chunk_t *blok) {
+    // Usuwany blok nie może pozostać punktem startowym polityki next fit
+    memory_manager.statystyki.bloki--;
+    if (memory_manager.wedrowny == blok) {
+        memory_manager.wedrowny = KAWALEK_POPRZEDNI(blok);
+    }
+    if (memory_manager.skaner == blok) {
+        memory_manager.skaner = KAWALEK_POPRZEDNI(blok);
+    }
+    size_t strona = indeks_strona(blok);
+    if (memory_manager.indeks_stron == NULL || strona >= HEAP_INDEX_PAGES ||
+        memory_manager.indeks_stron[strona] != blok) {
+        return;
+    }
+
+    // Ostatnim blokiem strony staje się poprzednik, o ile zaczyna się na tej samej stronie
+    struct memory_chunk_t *poprzedni = KAWALEK_POPRZEDNI(blok);
+    if (poprzedni != NULL && indeks_strona(poprzedni) == strona) {
+        memory_manager.indeks_stron[strona] = poprzedni;
+        return;
+    }
+    memory_manager.indeks_stron[strona] = NULL;
+    memory_manager.indeks_mapa[strona / 64] &= ~((uint64_t) 1 << (strona % 64));
+    if (memory_manager.indeks_mapa[strona / 64] == 0) {
+        memory_manager.indeks_podsumowanie[strona / 4096] &= ~((uint64_t) 1 << (strona / 64 % 64));
+    }
+}
+struct memory_chunk_t *indeks_znajdz(const void *wskaznik) {
+    // Wskaźnik musi leżeć w obszarze bloków sterty objętym indeksem
+    if (memory_manager.indeks_stron == NULL || memory_manager.pierwszy_kawalek == NULL ||
+        (const char *) wskaznik < (char *) memory_manager.pierwszy_kawalek ||
+        (const char *) wskaznik >= (char *) memory_manager.poczatek + memory_manager.wielkosc_pamieci ||
+        indeks_strona(wskaznik) >= HEAP_INDEX_PAGES) {
+        return NULL;
+    }
+
+    // Strona bez początku bloku należy do ostatniego bloku z wcześniejszej strony
+    size_t strona = indeks_strona(wskaznik);
+    struct memory_chunk_t *blok = memory_manager.indeks_stron[strona];
+    if (blok == NULL) {
+        size_t poprzednia = indeks_poprzednia_strona(strona);
+        return poprzednia == SIZE_MAX ? NULL : memory_manager.indeks_stron[poprzednia];
+    }
+
+    // Na stronie zaczyna się co najwyżej ROZMIAR_STRONY / 64 bloków - cofanie jest ograniczone
+    while (blok != NULL && (const char *) blok > (const char *) wskaznik) {
+        blok = KAWALEK_POPRZEDNI(blok);
+    }
+    return blok;
+}
+size_t indeks_poprzednia_strona(size_t strona) {
+    // Najpierw wcześniejsze strony z tego samego słowa mapy
+    size_t slowo = strona / 64;
+    uint64_t bity = memory_manager.indeks_mapa[slowo] & (((uint64_t) 1 << (strona % 64)) - 1);
+    if (bity != 0) {
+        return slowo * 64 + 63 - (size_t) __builtin_clzll(bity);
+    }
+
+    // Podsumowanie wskazuje niepuste słowa mapy, więc puste obszary są pomijane po 64 słowa naraz
+    size_t grupa = slowo / 64;
+    uint64_t slowa = memory_manager.indeks_podsumowanie[grupa] & (((uint64_t) 1 << (slowo % 64)) - 1);
+    while (slowa == 0) {
+        if (grupa == 0) {
+            return SIZE_MAX;
+        }
+        slowa = memory_manager.indeks_podsumowanie[--grupa];
+    }
+    slowo = grupa * 64 + 63 - (size_t) __builtin_clzll(slowa);
+    return slowo * 64 + 63 - (size_t) __builtin_clzll(memory_manager.indeks_mapa[slowo]);
+}
+
+size_t wzrost_dopisz(size_t chciany, size_t minimalny) {
+    // Najpierw z zapasem, a gdy pamięci brakuje - tylko tyle, ile konieczne
+    size_t rozmiar = chciany;
+    if (wywolaj_sbrk((intptr_t) rozmiar) == (void *) -1) {
+        rozmiar = minimalny;
+        if (rozmiar == chciany || wywolaj_sbrk((intptr_t) rozmiar) == (void *) -1) {
+            return 0;
+        }
+    }
+    memory_manager.wielkosc_pamieci += rozmiar;
+    return rozmiar;
+}
+size_t wzrost_rozszerz(size_t brakuje) {
+    // Sterta rośnie co najmniej o bieżący przyrost, a każde udane rozszerzenie podwaja następny (do przyrost_max)
+    size_t przyrost = memory_manager.przyrost > brakuje ? memory_manager.przyrost : brakuje;
+    size_t dopisane = wzrost_dopisz(przyrost, brakuje);
+    if (dopisane != 0 && memory_manager.przyrost < memory_manager.przyrost_max) {
+        memory_manager.przyrost = memory_manager.przyrost > memory_manager.przyrost_max / 2 ? memory_manager.przyrost_max
+                                                                                           : memory_manager.przyrost * 2;
+    }
+    return dopisane;
+}
+
+int heap_reserve(size_t size) {
+    int wynik = -1;
+    ZABLOKUJ_STERTE();
+    if (memory_manager.poczatek != NULL && (memory_manager.pierwszy_kawalek == NULL || walidacja_globalna() == 0)) {
+        // Wolny blok na końcu sterty powiększany jest do co najmniej size bajtów; tyle zostaje też przy przycinaniu
+        size_t obszar = (size + WYROWNANIE - 1) & ~(size_t) (WYROWNANIE - 1);
+        if (size == 0) {
+            memory_manager.rezerwa = 0;
+            wynik = 0;
+        } else if (obszar >= size) {
+            struct memory_chunk_t *blok = malloc_rozszerz_o_wolny_blok(obszar < MINIMALNY_OBSZAR ? MINIMALNY_OBSZAR : obszar);
+            if (blok != NULL) {
+                kosze_wstaw(blok);
+                blok->checksuma = oblicz_checksuma(blok);
+                memory_manager.rezerwa = obszar;
+                wynik = 0;
+            }
+        }
+    }
+    ODBLOKUJ_STERTE();
+    return wynik;
+}
+
+int heap_trim(size_t keep) {
+    ZABLOKUJ_STERTE();
+    size_t zwolnione = 0;
+    if (memory_manager.poczatek != NULL && memory_manager.pierwszy_kawalek != NULL && walidacja_globalna() == 0) {
+        zwolnione = przycinanie_wykonaj(keep);
+    }
+    ODBLOKUJ_STERTE();
+    return zwolnione != 0;
+}
+size_t przycinanie_wykonaj(size_t zostaw) {
+    // Oddać można tylko wolny blok na samym końcu sterty
+    struct memory_chunk_t *ostatni = memory_manager.ostatni_kawalek;
+    if (ostatni == NULL || !ostatni->czy_wolny || ostatni->wielkosc <= zostaw) {
+        return 0;
+    }
+
+    // Pozostawiony zapas zostaje wolnym blokiem; zbyt mały zapas oznacza oddanie całego bloku wraz z nagłówkiem
+    size_t nowy_obszar = (zostaw + WYROWNANIE - 1) & ~(size_t) (WYROWNANIE - 1);
+    if (nowy_obszar < MINIMALNY_OBSZAR) {
+        nowy_obszar = 0;
+    }
+    size_t zwolnij = nowy_obszar == 0 ? WIELKOSC_CHUNK + ostatni->wielkosc : ostatni->wielkosc - nowy_obszar;
+
+    // Blok zmienia rozmiar (lub znika), więc opuszcza swój kosz, zanim jego pamięć zostanie oddana
+    struct memory_chunk_t *poprzedni = KAWALEK_POPRZEDNI(ostatni);
+    kosze_usun(ostatni);
+    if (nowy_obszar == 0) {
+        indeks_usun(ostatni);
+    }
+    if (wywolaj_sbrk(-(intptr_t) zwolnij) == (void *) -1) {
+        if (nowy_obszar == 0) {
+            indeks_dodaj(ostatni);
+        }
+        kosze_wstaw(ostatni);
+        return 0;
+    }
+    memory_manager.wielkosc_pamieci -= zwolnij;
+
+    if (nowy_obszar != 0) {
+        ostatni->wielkosc = nowy_obszar;
+        kosze_wstaw(ostatni);
+        ostatni->checksuma = oblicz_checksuma(ostatni);
+    } else if (poprzedni != NULL) {
+        KAWALEK_USTAW_NASTEPNY(poprzedni, NULL);
+        poprzedni->checksuma = oblicz_checksuma(poprzedni);
+        memory_manager.ostatni_kawalek = poprzedni;
+    } else {
+        memory_manager.pierwszy_kawalek = NULL;
+        memory_manager.ostatni_kawalek = NULL;
+    }
+    return zwolnij;
+}
+void przycinanie_automatyczne(void) {
+    // Wolny koniec sterty większy od progu wraca przez custom_sbrk; zostaje rezerwa z heap_reserve albo bieżący
+    // przyrost, by sterta nie rosła i nie malała na przemian przy każdym kolejnym przydziale
+    struct memory_chunk_t *ostatni = memory_manager.ostatni_kawalek;
+    size_t zostaw = memory_manager.rezerwa > memory_manager.przyrost ? memory_manager.rezerwa : memory_manager.przyrost;
+    if (memory_manager.prog_przycinania != 0 && ostatni != NULL && ostatni->czy_wolny &&
+        ostatni->wielkosc >= memory_manager.prog_przycinania + zostaw) {
+        przycinanie_wykonaj(zostaw);
+    }
+}
+
+#ifdef HEAP_THREAD_SAFE
+// Wątek skanera w tle - jeden na proces, sprawdza wskazaną stertę porcjami co zadany odstęp
+static pthread_t watek_skanera;
+static atomic_int skaner_w_tle;
+static heap_t *sterta_skanera;
+static size_t porcja_skanera;
+static unsigned odstep_skanera;
+#endif
+
+void heap_scrub_set_callback(heap_scrub_callback_t callback, void *arg) {
+    ZABLOKUJ_STERTE();
+    memory_manager.zgloszenie = callback;
+    memory_manager.zgloszenie_argument = arg;
+    ODBLOKUJ_STERTE();
+}
+size_t heap_scrub(size_t budget) {
+    // Krok sprawdza najwyżej budget bloków od miejsca, w którym skończył poprzedni, i kończy się wraz z przejściem
+    // sterty; bloki sterty, a po nich bloki mapowane
+    size_t uszkodzone = 0;
+    ZABLOKUJ_STERTE();
+    for (size_t i = 0; i < budget && memory_manager.poczatek != NULL; i++) {
+        struct memory_chunk_t *kawalek = memory_manager.skaner;
+        if (kawalek == NULL) {
+            kawalek = memory_manager.pierwszy_kawalek != NULL ? memory_manager.pierwszy_kawalek : memory_manager.duze_bloki;
+            if (kawalek == NULL) {
+                break;
+            }
+        }
+
+        enum heap_damage_t uszkodzenie = skaner_sprawdz(kawalek);
+        if (uszkodzenie != heap_damage_none) {
+            uszkodzone++;
+            if (memory_manager.zgloszenie != NULL) {
+                memory_manager.zgloszenie(kawalek, uszkodzenie, memory_manager.zgloszenie_argument);
+            }
+        }
+
+        // Powiązania uszkodzonego nagłówka nie są wiarygodne - kolejne przejście zaczyna się od początku sterty
+        memory_manager.skaner = uszkodzenie == heap_damage_checksum ? NULL : skaner_nastepny(kawalek);
+        if (memory_manager.skaner == NULL) {
+            break;
+        }
+    }
+    ODBLOKUJ_STERTE();
+    return uszkodzone;
+}
+enum heap_damage_t skaner_sprawdz(struct memory_chunk_t *kawalek) {
+    // Te same sprawdzenia co w pełnej walidacji, z rozróżnieniem rodzaju uszkodzenia
+    if (kawalek->checksuma != oblicz_checksuma(kawalek)) {
+        return heap_damage_checksum;
+    }
+    if (kawalek->rodzaj != RODZAJ_MMAP) {
+        int poprzedni_wolny = KAWALEK_POPRZEDNI(kawalek) != NULL && KAWALEK_POPRZEDNI(kawalek)->czy_wolny;
+        if (kawalek->poprzedni_wolny != poprzedni_wolny) {
+            return heap_damage_boundary_tag;
+        }
+    }
+    if (kawalek->czy_wolny && *znacznik_stopka(kawalek) != kawalek->wielkosc) {
+        return heap_damage_boundary_tag;
+    }
+    if (kawalek->czy_wolny == 0 && !sprawdzaj_plotka(kawalek)) {
+        return heap_damage_fence;
+    }
+    if (kawalek->rodzaj == RODZAJ_SLAB && !slab_sprawdz(kawalek)) {
+        return heap_damage_slab;
+    }
+    return heap_damage_none;
+}
+struct memory_chunk_t *skaner_nastepny(struct memory_chunk_t *kawalek) {
+    // Za ostatnim blokiem sterty przychodzi kolej na listę bloków mapowanych
+    if (kawalek->rodzaj == RODZAJ_MMAP || KAWALEK_NASTEPNY(kawalek) != NULL) {
+        return KAWALEK_NASTEPNY(kawalek);
+    }
+    return memory_manager.duze_bloki;
+}
+#ifdef HEAP_THREAD_SAFE
+static void *skaner_watek(void *argument) {
+    (void) argument;
+    sterta_wybierz(sterta_skanera);
+    struct timespec odstep = {.tv_sec = odstep_skanera / 1000, .tv_nsec = (long) (odstep_skanera % 1000) * 1000000};
+    while (atomic_load(&skaner_w_tle)) {
+        heap_scrub(porcja_skanera);
+        nanosleep(&odstep, NULL);
+    }
+    return NULL;
+}
+int heap_scrub_start(heap_t *heap, size_t budget, unsigned interval_ms) {
+    int wylaczony = 0;
+    if (budget == 0 || !atomic_compare_exchange_strong(&skaner_w_tle, &wylaczony, 1)) {
+        return -1;
+    }
+    sterta_skanera = heap;
+    porcja_skanera = budget;
+    odstep_skanera = interval_ms;
+    if (pthread_create(&watek_skanera, NULL, skaner_watek, NULL) != 0) {
+        atomic_store(&skaner_w_tle, 0);
+        return -1;
+    }
+    return 0;
+}
+void heap_scrub_stop(void) {
+    // Wątek kończy się po bieżącym odstępie
+    int wlaczony = 1;
+    if (atomic_compare_exchange_strong(&skaner_w_tle, &wlaczony, 0)) {
+        pthread_join(watek_skanera, NULL);
+    }
+}
+#endif
+
+// Stan zapisu śladu nie należy do sterty - przetrwa heap_clean i ponowne heap_setup
+static struct heap_trace_event_t bufor_sladu[HEAP_TRACE_BUFFER];
+static size_t zdarzenia_w_buforze;
+static int plik_sladu = -1;
+static uint64_t poczatek_sladu;
+static uint32_t liczba_watkow_sladu;
+#ifdef HEAP_THREAD_SAFE
+static atomic_int slad_wlaczony;
+#else
+static int slad_wlaczony;
+#endif
+// Operacje wywołane wewnątrz zapisywanej operacji (np. heap_malloc z heap_calloc) nie są osobnymi zdarzeniami
+static _Thread_local int slad_zagniezdzenie;
+static _Thread_local uint32_t watek_sladu;
+
+static uint64_t slad_czas(void) {
+    struct timespec czas;
+    clock_gettime(CLOCK_MONOTONIC, &czas);
+    return (uint64_t) czas.tv_sec * 1000000000u + (uint64_t) czas.tv_nsec;
+}
+
+int heap_trace_start(const char *path) {
+    if (path == NULL) {
+        return -1;
+    }
+    ZABLOKUJ_STERTE();
+    if (plik_sladu >= 0) {
+        ODBLOKUJ_STERTE();
+        return -1;
+    }
+
+    // Nagłówek pozwala narzędziu odtwarzającemu rozpoznać format i wielkość zdarzenia
+    int plik = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    struct heap_trace_header_t naglowek = {HEAP_TRACE_MAGIC, HEAP_TRACE_VERSION, sizeof(struct heap_trace_event_t), 0};
+    if (plik < 0 || write(plik, &naglowek, sizeof(naglowek)) != (ssize_t) sizeof(naglowek)) {
+        if (plik >= 0) {
+            close(plik);
+        }
+        ODBLOKUJ_STERTE();
+        return -1;
+    }
+
+    plik_sladu = plik;
+    zdarzenia_w_buforze = 0;
+    poczatek_sladu = slad_czas();
+    slad_wlaczony = 1;
+    ODBLOKUJ_STERTE();
+    return 0;
+}
+int heap_trace_stop(void) {
+    ZABLOKUJ_STERTE();
+    if (plik_sladu < 0) {
+        ODBLOKUJ_STERTE();
+        return -1;
+    }
+
+    slad_wlaczony = 0;
+    int wynik = slad_oproznij();
+    if (close(plik_sladu) != 0) {
+        wynik = -1;
+    }
+    plik_sladu = -1;
+    ODBLOKUJ_STERTE();
+    return wynik;
+}
+int slad_aktywny(void) {
+    return slad_wlaczony && slad_zagniezdzenie == 0;
+}
+void slad_zapisz(enum heap_trace_operation_t operacja, size_t rozmiar, const void *obiekt, const void *wynik) {
+    // Wywoływana pod blokadą sterty - zapis kończy się przed wykonaniem kolejnej operacji w innym wątku
+    if (plik_sladu < 0) {
+        return;
+    }
+    if (watek_sladu == 0) {
+        watek_sladu = ++liczba_watkow_sladu;
+    }
+
+    bufor_sladu[zdarzenia_w_buforze++] = (struct heap_trace_event_t) {
+            .operation = operacja,
+            .thread = watek_sladu,
+            .timestamp = slad_czas() - poczatek_sladu,
+            .size = rozmiar,
+            .id = (uint64_t) (uintptr_t) obiekt,
+            .result = (uint64_t) (uintptr_t) wynik
+    };
+    if (zdarzenia_w_buforze == HEAP_TRACE_BUFFER) {
+        slad_oproznij();
+    }
+}
+int slad_oproznij(void) {
+    // Zapis całego bufora; niepełny zapis (np. brak miejsca na dysku) kończy śledzenie
+    size_t bajty = zdarzenia_w_buforze * sizeof(struct heap_trace_event_t);
+    const char *dane = (const char *) bufor_sladu;
+    zdarzenia_w_buforze = 0;
+    while (bajty > 0) {
+        ssize_t zapisane = write(plik_sladu, dane, bajty);
+        if (zapisane <= 0) {
+            slad_wlaczony = 0;
+            return -1;
+        }
+        dane += zapisane;
+        bajty -= (size_t) zapisane;
+    }
+    return 0;
+}
+void *slad_malloc(size_t rozmiar) {
+    // Cała operacja wraz z zapisem pod blokadą, by kolejność zdarzeń odpowiadała kolejności operacji
+    ZABLOKUJ_STERTE();
+    slad_zagniezdzenie++;
+    void *wynik = heap_malloc(rozmiar);
+    slad_zagniezdzenie--;
+    slad_zapisz(heap_trace_malloc, rozmiar, wynik, NULL);
+    ODBLOKUJ_STERTE();
+    return wynik;
+}
+void *slad_calloc(size_t liczba, size_t ile) {
+    ZABLOKUJ_STERTE();
+    slad_zagniezdzenie++;
+    void *wynik = heap_calloc(liczba, ile);
+    slad_zagniezdzenie--;
+    slad_zapisz(heap_trace_calloc, liczba * ile, wynik, NULL);
+    ODBLOKUJ_STERTE();
+    return wynik;
+}
+void *slad_realloc(void *blok_pamieci, size_t rozmiar) {
+    ZABLOKUJ_STERTE();
+    slad_zagniezdzenie++;
+    void *wynik = heap_realloc(blok_pamieci, rozmiar);
+    slad_zagniezdzenie--;
+    slad_zapisz(heap_trace_realloc, rozmiar, blok_pamieci, wynik);
+    ODBLOKUJ_STERTE();
+    return wynik;
+}
+void *slad_aligned_alloc(size_t wyrownanie, size_t rozmiar) {
+    // Odtworzenie nie zna wyrównania - zdarzenie malloc z żądanym rozmiarem
+    ZABLOKUJ_STERTE();
+    slad_zagniezdzenie++;
+    void *wynik = heap_aligned_alloc(wyrownanie, rozmiar);
+    slad_zagniezdzenie--;
+    slad_zapisz(heap_trace_malloc, rozmiar, wynik, NULL);
+    ODBLOKUJ_STERTE();
+    return wynik;
+}
+void slad_free(void *blok_pamieci) {
+    ZABLOKUJ_STERTE();
+    slad_zagniezdzenie++;
+    heap_free(blok_pamieci);
+    slad_zagniezdzenie--;
+    slad_zapisz(heap_trace_free, 0, blok_pamieci, NULL);
+    ODBLOKUJ_STERTE();
+}
+
+size_t mmap_rozmiar_mapowania(size_t rozmiar) {
+    // Nagłówek, płotki i dane zaokrąglone do pełnych stron - rozmiar odwzorowania wynika z rozmiaru bloku
+    return (PRZEDROSTEK_MMAP + POCZATEK_DANYCH + rozmiar + PLOTEK_ZA + ROZMIAR_STRONY - 1) & ~(size_t) (ROZMIAR_STRONY - 1);
+}
+void *mmap_przydziel(size_t rozmiar) {
+#ifdef HEAP_COMPACT_HEADER
+    if (rozmiar > NAJWIEKSZY_ROZMIAR_BLOKU) {
+        return NULL;
+    }
+#endif
+    void *pamiec = mmap(NULL, mmap_rozmiar_mapowania(rozmiar), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pamiec == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Nowy blok trafia na początek listy bloków mapowanych
+    struct memory_chunk_t *blok = (struct memory_chunk_t *) ((char *) pamiec + PRZEDROSTEK_MMAP);
+    *blok = (struct memory_chunk_t) {.wielkosc = rozmiar, .czy_wolny = 0, .rodzaj = RODZAJ_MMAP};
+    KAWALEK_USTAW_POPRZEDNI(blok, NULL);
+    KAWALEK_USTAW_NASTEPNY(blok, memory_manager.duze_bloki);
+    memory_manager.duze_bloki = blok;
+    mmap_dolacz_sasiadow(blok);
+    memory_manager.statystyki.bloki_mmap++;
+    memory_manager.statystyki.bajty_mmap += mmap_rozmiar_mapowania(rozmiar);
+
+    malloc_inicjalizuj_blok_pamieci(blok);
+    blok->checksuma = oblicz_checksuma(blok);
+    return (void *) ((char *) blok + POCZATEK_DANYCH);
+}
+struct memory_chunk_t *mmap_znajdz(const void *wskaznik) {
+    // Odwzorowań jest niewiele (każde ma co najmniej prog_mmap bajtów), więc wystarcza przejście listy
+    for (struct memory_chunk_t *blok = memory_manager.duze_bloki; blok != NULL; blok = KAWALEK_NASTEPNY(blok)) {
+        if ((const char *) wskaznik >= (char *) blok &&
+            (const char *) wskaznik < (char *) blok - PRZEDROSTEK_MMAP + mmap_rozmiar_mapowania(blok->wielkosc)) {
+            return blok;
+        }
+    }
+    return NULL;
+}
+void mmap_zwolnij(struct memory_chunk_t *blok) {
+    // Odłączenie od listy bloków mapowanych (skaner przechodzi do następnego)
+    if (memory_manager.skaner == blok) {
+        memory_manager.skaner = KAWALEK_NASTEPNY(blok);
+    }
+    if (KAWALEK_POPRZEDNI(blok) != NULL) {
+        KAWALEK_USTAW_NASTEPNY(KAWALEK_POPRZEDNI(blok), KAWALEK_NASTEPNY(blok));
+        KAWALEK_POPRZEDNI(blok)->checksuma = oblicz_checksuma(KAWALEK_POPRZEDNI(blok));
+    } else {
+        memory_manager.duze_bloki = KAWALEK_NASTEPNY(blok);
+    }
+    if (KAWALEK_NASTEPNY(blok) != NULL) {
+        KAWALEK_USTAW_POPRZEDNI(KAWALEK_NASTEPNY(blok), KAWALEK_POPRZEDNI(blok));
+        KAWALEK_NASTEPNY(blok)->checksuma = oblicz_checksuma(KAWALEK_NASTEPNY(blok));
+    }
+
+    memory_manager.statystyki.bloki_mmap--;
+    memory_manager.statystyki.bajty_mmap -= mmap_rozmiar_mapowania(blok->wielkosc);
+    munmap((char *) blok - PRZEDROSTEK_MMAP, mmap_rozmiar_mapowania(blok->wielkosc));
+}
+void *mmap_zmien_rozmiar(struct memory_chunk_t *blok, size_t rozmiar) {
+#ifdef HEAP_COMPACT_HEADER
+    if (rozmiar > NAJWIEKSZY_ROZMIAR_BLOKU) {
+        return NULL;
+    }
+#endif
+    size_t stary_rozmiar = mmap_rozmiar_mapowania(blok->wielkosc);
+    size_t nowy_rozmiar = mmap_rozmiar_mapowania(rozmiar);
+
+    // Zmiana liczby stron przenosi odwzorowanie (jądro przemapowuje strony bez kopiowania danych)
+    if (nowy_rozmiar != stary_rozmiar) {
+        struct memory_chunk_t *poprzedni = KAWALEK_POPRZEDNI(blok);
+        struct memory_chunk_t *nastepny = KAWALEK_NASTEPNY(blok);
+#ifdef MREMAP_MAYMOVE
+        void *pamiec = mremap((char *) blok - PRZEDROSTEK_MMAP, stary_rozmiar, nowy_rozmiar, MREMAP_MAYMOVE);
+        if (pamiec == MAP_FAILED) {
+            return NULL;
+        }
+#else
+        void *pamiec = mmap(NULL, nowy_rozmiar, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pamiec == MAP_FAILED) {
+            return NULL;
+        }
+        memcpy(pamiec, (char *) blok - PRZEDROSTEK_MMAP, stary_rozmiar < nowy_rozmiar ? stary_rozmiar : nowy_rozmiar);
+        munmap((char *) blok - PRZEDROSTEK_MMAP, stary_rozmiar);
+#endif
+        // Powiązania względne liczone są od nowego miejsca bloku
+        struct memory_chunk_t *stary_blok = blok;
+        blok = (struct memory_chunk_t *) ((char *) pamiec + PRZEDROSTEK_MMAP);
+        if (memory_manager.skaner == stary_blok) {
+            memory_manager.skaner = blok;
+        }
+        KAWALEK_USTAW_POPRZEDNI(blok, poprzedni);
+        KAWALEK_USTAW_NASTEPNY(blok, nastepny);
+        if (poprzedni == NULL) {
+            memory_manager.duze_bloki = blok;
+        }
+        mmap_dolacz_sasiadow(blok);
+        memory_manager.statystyki.bajty_mmap += nowy_rozmiar - stary_rozmiar;
+    }
+
+    // Nowy tylny płotek za zmienionym obszarem danych
+    blok->wielkosc = rozmiar;
+    char *dane = (char *) blok + POCZATEK_DANYCH + rozmiar;
+    for (size_t i = 0; i < PLOTEK_ZA; i++) {
+        dane[i] = '#';
+    }
+    blok->checksuma = oblicz_checksuma(blok);
+    return (void *) ((char *) blok + POCZATEK_DANYCH);
+}
+void mmap_dolacz_sasiadow(struct memory_chunk_t *blok) {
+    // Sąsiedzi na liście muszą wskazywać na (być może przeniesiony) blok
+    if (KAWALEK_POPRZEDNI(blok) != NULL) {
+        KAWALEK_USTAW_NASTEPNY(KAWALEK_POPRZEDNI(blok), blok);
+        KAWALEK_POPRZEDNI(blok)->checksuma = oblicz_checksuma(KAWALEK_POPRZEDNI(blok));
+    }
+    if (KAWALEK_NASTEPNY(blok) != NULL) {
+        KAWALEK_USTAW_POPRZEDNI(KAWALEK_NASTEPNY(blok), blok);
+        KAWALEK_NASTEPNY(blok)->checksuma = oblicz_checksuma(KAWALEK_NASTEPNY(blok));
+    }
+}
+
+size_t slab_klasa(size_t rozmiar) {
+    // Klasy są kolejnymi potęgami dwójki od NAJMNIEJSZY_OBIEKT_SLABU
+    size_t klasa = 0;
+    while ((size_t) NAJMNIEJSZY_OBIEKT_SLABU << klasa < rozmiar) {
+        klasa++;
+    }
+    return klasa;
+}
+size_t slab_poczatek_obiektow(void) {
+    // Obiekty zaczynają się za nagłówkiem slabu, wyrównane do 16 bajtów
+    return (sizeof(struct slab_t) + 15) & ~(size_t) 15;
+}
+struct slab_t *slab_poprzedni(struct slab_t *slab) {
+    return adres_wzgledny(slab, slab->poprzedni);
+}
+struct slab_t *slab_nastepny(struct slab_t *slab) {
+    return adres_wzgledny(slab, slab->nastepny);
+}
+struct memory_chunk_t *slab_kawalek(struct slab_t *slab) {
+    return adres_wzgledny(slab, slab->kawalek);
+}
+struct slab_t **slab_lista(size_t klasa, uint8_t wlasciciel) {
+#ifdef HEAP_THREAD_SAFE
+    // Slaby należące do miejsca pamięci wątku tworzą jego własne listy
+    if (wlasciciel != 0) {
+        return pamiec_watku_lista_slabow(wlasciciel, klasa);
+    }
+#else
+    (void) wlasciciel;
+#endif
+    return &memory_manager.slaby[klasa];
+}
+void slab_wstaw(struct slab_t *slab) {
+    // Slab trafia na początek listy swojej klasy
+    struct slab_t **lista = slab_lista(slab->klasa, slab->wlasciciel);
+    struct slab_t *nastepny = *lista;
+    slab->poprzedni = 0;
+    slab->nastepny = przesuniecie_wzgledne(slab, nastepny);
+    if (nastepny) {
+        nastepny->poprzedni = przesuniecie_wzgledne(nastepny, slab);
+    }
+    *lista = slab;
+}
+void slab_usun(struct slab_t *slab) {
+    struct slab_t *poprzedni = slab_poprzedni(slab);
+    struct slab_t *nastepny = slab_nastepny(slab);
+    if (poprzedni) {
+        poprzedni->nastepny = przesuniecie_wzgledne(poprzedni, nastepny);
+    } else {
+        *slab_lista(slab->klasa, slab->wlasciciel) = nastepny;
+    }
+    if (nastepny) {
+        nastepny->poprzedni = przesuniecie_wzgledne(nastepny, poprzedni);
+    }
+    slab->nastepny = slab->poprzedni = 0;
+}
+struct slab_t *slab_utworz(size_t klasa, uint8_t wlasciciel) {
+    // Slab to zwykły blok, którego dane są wyrównane do własnego rozmiaru
+    void *dane = malloc_przydziel_wyrownany(ROZMIAR_SLABU, ROZMIAR_DANYCH_SLABU);
+    if (dane == NULL) {
+        return NULL;
+    }
+    struct memory_chunk_t *kawalek = (struct memory_chunk_t *) ((char *) dane - POCZATEK_DANYCH);
+    kawalek->rodzaj = RODZAJ_SLAB;
+    kawalek->checksuma = oblicz_checksuma(kawalek);
+
+    struct slab_t *slab = (struct slab_t *) dane;
+    size_t rozmiar_obiektu = (size_t) NAJMNIEJSZY_OBIEKT_SLABU << klasa;
+    *slab = (struct slab_t) {
+            .magia = MAGIA_SLABU,
+            .klasa = (uint16_t) klasa,
+            .pojemnosc = (uint16_t) ((ROZMIAR_DANYCH_SLABU - slab_poczatek_obiektow()) / rozmiar_obiektu),
+            .rozmiar_obiektu = (uint16_t) rozmiar_obiektu,
+            .wlasciciel = wlasciciel
+    };
+    slab->kawalek = przesuniecie_wzgledne(slab, kawalek);
+    slab->wolne = slab->pojemnosc;
+
+    // Wszystkie obiekty wolne - ustawione bity od 0 do pojemności
+    for (size_t i = 0; i < slab->pojemnosc; i++) {
+        slab->mapa_wolnych[i / 64] |= (uint64_t) 1 << (i % 64);
+    }
+
+    // Nowy slab trafia na listę slabów z wolnymi obiektami, a jego strona dostaje znacznik w indeksie
+    slab_wstaw(slab);
+    indeks_oznacz_slab(slab, 1);
+    return slab;
+}
+void *slab_przydziel(size_t rozmiar) {
+    return slab_przydziel_z(slab_klasa(rozmiar), 0);
+}
+void *slab_przydziel_z(size_t klasa, uint8_t wlasciciel) {
+    // Obiekt ze wspólnych slabów albo ze slabów miejsca pamięci wątku
+    struct slab_t *slab = *slab_lista(klasa, wlasciciel);
+    if (slab == NULL) {
+        slab = slab_utworz(klasa, wlasciciel);
+        if (slab == NULL) {
+            return NULL;
+        }
+    }
+
+    // Pierwszy wolny obiekt według mapy bitowej slabu
+    size_t indeks = 0;
+    for (size_t slowo = 0; slowo < sizeof(slab->mapa_wolnych) / sizeof(slab->mapa_wolnych[0]); slowo++) {
+        if (slab->mapa_wolnych[slowo]) {
+            indeks = slowo * 64 + (size_t) __builtin_ctzll(slab->mapa_wolnych[slowo]);
+            break;
+        }
+    }
+    // Mapę wolnych odczytuje też zwolnienie do pamięci podręcznej wątku, wykonywane bez blokady
+    __atomic_fetch_and(&slab->mapa_wolnych[indeks / 64], ~((uint64_t) 1 << (indeks % 64)), __ATOMIC_RELAXED);
+
+    // Pełny slab opuszcza listę slabów z wolnymi obiektami
+    if (--slab->wolne == 0) {
+        slab_usun(slab);
+    }
+
+    return (char *) slab + slab_poczatek_obiektow() + indeks * slab->rozmiar_obiektu;
+}
+struct slab_t *slab_znajdz(const void *wskaznik) {
+    // Slab leży na początku wyrównanego obszaru, w którym znajduje się wskaźnik
+    struct slab_t *slab = (struct slab_t *) ((uintptr_t) wskaznik & ~(uintptr_t) (ROZMIAR_SLABU - 1));
+    if (wskaznik == NULL || memory_manager.pierwszy_kawalek == NULL ||
+        (char *) slab < (char *) memory_manager.pierwszy_kawalek + POCZATEK_DANYCH ||
+        (char *) slab >= (char *) memory_manager.poczatek + memory_manager.wielkosc_pamieci ||
+        (char *) wskaznik < (char *) slab + slab_poczatek_obiektow() ||
+        (char *) wskaznik >= (char *) slab + ROZMIAR_DANYCH_SLABU) {
+        return NULL;
+    }
+
+    // Strona bez znacznika w indeksie nie jest slabem - nagłówek nie musi być odczytywany
+    if (memory_manager.strony_slabow != NULL && indeks_slab(wskaznik) == NULL) {
+        return NULL;
+    }
+
+    // Slab musi wskazywać na blok płytowy, którego dane zaczynają się dokładnie w nim
+    if (slab->magia != MAGIA_SLABU || (char *) slab_kawalek(slab) != (char *) slab - POCZATEK_DANYCH ||
+        slab_kawalek(slab)->rodzaj != RODZAJ_SLAB || slab_kawalek(slab)->czy_wolny) {
+        return NULL;
+    }
+    return slab;
+}
+int slab_zwolnij(struct slab_t *slab, void *wskaznik) {
+    // Wskaźnik musi wskazywać początek zajętego obiektu
+    size_t przesuniecie = (size_t) ((char *) wskaznik - (char *) slab) - slab_poczatek_obiektow();
+    size_t indeks = przesuniecie / slab->rozmiar_obiektu;
+    if (przesuniecie % slab->rozmiar_obiektu != 0 || indeks >= slab->pojemnosc ||
+        slab->mapa_wolnych[indeks / 64] & ((uint64_t) 1 << (indeks % 64))) {
+        return 0;
+    }
+
+    // Obiekt w pamięci podręcznej wątku jest już zwolniony - wraca do slabu dopiero z niej
+    if (slab_obiekt_w_pamieci_watku(slab, indeks)) {
+        return 0;
+    }
+    __atomic_fetch_or(&slab->mapa_wolnych[indeks / 64], (uint64_t) 1 << (indeks % 64), __ATOMIC_RELAXED);
+
+    // Slab z pierwszym wolnym obiektem wraca na listę swojej klasy
+    if (slab->wolne++ == 0) {
+        slab_wstaw(slab);
+    }
+
+    // Pusty slab oddajemy stercie, o ile nie jest jedynym slabem na swojej liście
+    if (slab->wolne == slab->pojemnosc && (slab->poprzedni != 0 || slab->nastepny != 0)) {
+        slab_zniszcz(slab);
+    }
+    return 1;
+}
+void slab_zniszcz(struct slab_t *slab) {
+    // Pusty slab opuszcza listę, a jego strona traci znacznik, zanim blok wróci na stertę
+    slab_usun(slab);
+
+    struct memory_chunk_t *kawalek = slab_kawalek(slab);
+    indeks_oznacz_slab(slab, 0);
+    slab->magia = 0;
+    kawalek->rodzaj = RODZAJ_ZWYKLY;
+    free_zwolnij_blok(kawalek);
+}
+int slab_obiekt_w_pamieci_watku(struct slab_t *slab, size_t indeks) {
+    // Bity ustawia bez blokady zwolnienie do pamięci podręcznej wątku
+    return (__atomic_load_n(&slab->mapa_podrecznych[indeks / 64], __ATOMIC_ACQUIRE) & ((uint64_t) 1 << (indeks % 64))) != 0;
+}
+int slab_sprawdz(struct memory_chunk_t *kawalek) {
+    // Nagłówek slabu musi wskazywać z powrotem na swój blok
+    struct slab_t *slab = (struct slab_t *) ((char *) kawalek + POCZATEK_DANYCH);
+    return slab->magia == MAGIA_SLABU && slab_kawalek(slab) == kawalek && slab->wolne <= slab->pojemnosc;
+}
+enum pointer_type_t slab_okresl_typ(struct slab_t *slab, const void *wskaznik) {
+    if ((char *) wskaznik < (char *) slab + slab_poczatek_obiektow()) {
+        return pointer_control_block;
+    }
+
+    size_t przesuniecie = (size_t) ((const char *) wskaznik - (char *) slab) - slab_poczatek_obiektow();
+    size_t indeks = przesuniecie / slab->rozmiar_obiektu;
+    if (indeks >= slab->pojemnosc || slab->mapa_wolnych[indeks / 64] & ((uint64_t) 1 << (indeks % 64)) ||
+        slab_obiekt_w_pamieci_watku(slab, indeks)) {
+        return pointer_unallocated;
+    }
+    return przesuniecie % slab->rozmiar_obiektu == 0 ? pointer_valid : pointer_inside_data_block;
+}
+size_t slab_najwiekszy_zajety(struct memory_chunk_t *kawalek) {
+    // Obiekty w pamięciach podręcznych wątków są zajęte dla slabu, ale zwolnione dla programu
+    struct slab_t *slab = (struct slab_t *) ((char *) kawalek + POCZATEK_DANYCH);
+    for (size_t slowo = 0; slab->wolne < slab->pojemnosc && slowo * 64 < slab->pojemnosc; slowo++) {
+        uint64_t zajete = ~slab->mapa_wolnych[slowo] & ~__atomic_load_n(&slab->mapa_podrecznych[slowo], __ATOMIC_ACQUIRE);
+        if (slab->pojemnosc - slowo * 64 < 64) {
+            zajete &= ((uint64_t) 1 << (slab->pojemnosc - slowo * 64)) - 1;
+        }
+        if (zajete != 0) {
+            return slab->rozmiar_obiektu;
+        }
+    }
+    return 0;
+}
+
+#ifdef HEAP_THREAD_SAFE
+static struct pamiec_watku_t pamieci_watkow[MAKS_PAMIECI_WATKOW];
+static _Thread_local struct pamiec_watku_t *pamiec_tego_watku;
+static _Thread_local int pamiec_watku_niedostepna;
+static pthread_key_t klucz_pamieci_watku;
+static pthread_once_t klucz_pamieci_watku_raz = PTHREAD_ONCE_INIT;
+
+static void pamiec_watku_utworz_klucz(void) {
+    pthread_key_create(&klucz_pamieci_watku, pamiec_watku_zakoncz);
+}
+static size_t pamiec_watku_klasa(size_t rozmiar) {
+    // Małe rozmiary zaokrąglane są do obiektu slabu, którym klasa jest uzupełniana
+    if (__atomic_load_n(&memory_manager.slaby_wlaczone, __ATOMIC_RELAXED) && rozmiar <= NAJWIEKSZY_OBIEKT_SLABU) {
+        rozmiar = (size_t) NAJMNIEJSZY_OBIEKT_SLABU << slab_klasa(rozmiar);
+    }
+    return (rozmiar - 1) / KROK_KLASY_PAMIECI_WATKU;
+}
+static size_t pamiec_watku_klasa_obiektu(void *obiekt) {
+    // Rozmiar obiektu slabu i wielkość bloku nie zmieniają się, dopóki obiekt należy do pamięci wątku
+    struct slab_t *slab = indeks_slab(obiekt);
+    if (slab != NULL) {
+        return slab->rozmiar_obiektu / KROK_KLASY_PAMIECI_WATKU - 1;
+    }
+    struct memory_chunk_t *blok = (struct memory_chunk_t *) ((char *) obiekt - POCZATEK_DANYCH);
+    return blok->wielkosc / KROK_KLASY_PAMIECI_WATKU - 1;
+}
+static size_t pamiec_watku_indeks_obiektu(struct slab_t *slab, void *obiekt) {
+    return (size_t) ((char *) obiekt - (char *) slab - slab_poczatek_obiektow()) / slab->rozmiar_obiektu;
+}
+static int pamiec_watku_zwolnij_ze_slabu(struct slab_t *slab, void *obiekt) {
+    // Pola slabu poza mapami nie zmieniają się, dopóki na stronie jest znacznik slabu
+    uint8_t wlasciciel = slab->wlasciciel;
+    if (wlasciciel == 0 || wlasciciel > MAKS_PAMIECI_WATKOW) {
+        return 0;
+    }
+    size_t przesuniecie = (size_t) ((char *) obiekt - (char *) slab);
+    if (przesuniecie < slab_poczatek_obiektow() ||
+        (przesuniecie - slab_poczatek_obiektow()) % slab->rozmiar_obiektu != 0) {
+        return 0;
+    }
+    size_t indeks = pamiec_watku_indeks_obiektu(slab, obiekt);
+    uint64_t bit = (uint64_t) 1 << (indeks % 64);
+    if (indeks >= slab->pojemnosc || (__atomic_load_n(&slab->mapa_wolnych[indeks / 64], __ATOMIC_RELAXED) & bit) != 0) {
+        return 0;
+    }
+
+    // Obiekt leżący już w pamięci podręcznej jest zwolniony - z równoczesnych zwolnień bit ustawia tylko jedno
+    if (__atomic_fetch_or(&slab->mapa_podrecznych[indeks / 64], bit, __ATOMIC_ACQ_REL) & bit) {
+        return -1;
+    }
+    pamiec_watku_przekaz(&pamieci_watkow[wlasciciel - 1], obiekt);
+    return 1;
+}
+static void pamiec_watku_wloz(struct pamiec_watku_t *pamiec, void *obiekt, size_t klasa) {
+    // Obiekty w pamięci wątku są łączone przez pierwsze bajty swoich danych
+    *(void **) obiekt = pamiec->listy[klasa];
+    pamiec->listy[klasa] = obiekt;
+    pamiec->ile[klasa]++;
+}
+
+struct pamiec_watku_t *pamiec_watku_pobierz(void) {
+    if (pamiec_tego_watku != NULL || pamiec_watku_niedostepna) {
+        return pamiec_tego_watku;
+    }
+    pthread_once(&klucz_pamieci_watku_raz, pamiec_watku_utworz_klucz);
+
+    // Zajęcie wolnego miejsca w tablicy pamięci wątków
+    for (size_t i = 0; i < MAKS_PAMIECI_WATKOW; i++) {
+        int wolna = 0;
+        if (atomic_compare_exchange_strong(&pamieci_watkow[i].zajeta, &wolna, 1)) {
+            pamiec_tego_watku = &pamieci_watkow[i];
+            pthread_setspecific(klucz_pamieci_watku, pamiec_tego_watku);
+
+            // Zwolnienia skierowane do poprzedniego właściciela miejsca przejmuje nowy wątek
+            pamiec_watku_odbierz_zdalne(pamiec_tego_watku);
+            return pamiec_tego_watku;
+        }
+    }
+
+    // Brak miejsc - ten wątek korzysta wyłącznie ze wspólnej sterty
+    pamiec_watku_niedostepna = 1;
+    return NULL;
+}
+void *pamiec_watku_przydziel(size_t rozmiar) {
+    // Pamięci wątków należą do sterty głównej i wymagają jej indeksu stron (zwolnienie bez blokady rozpoznaje
+    // w nim obiekty slabów)
+    if (biezaca_sterta != &glowna_sterta || rozmiar == 0 || rozmiar > KLASY_PAMIECI_WATKU * KROK_KLASY_PAMIECI_WATKU ||
+        memory_manager.strony_slabow == NULL) {
+        return NULL;
+    }
+    struct pamiec_watku_t *pamiec = pamiec_watku_pobierz();
+    if (pamiec == NULL) {
+        return NULL;
+    }
+
+    // Najpierw bloki zwolnione przez inne wątki, potem uzupełnienie porcją ze wspólnej sterty
+    size_t klasa = pamiec_watku_klasa(rozmiar);
+    if (atomic_load_explicit(&pamiec->zdalne, memory_order_relaxed) != NULL) {
+        pamiec_watku_odbierz_zdalne(pamiec);
+    }
+    if (pamiec->listy[klasa] == NULL) {
+        pamiec_watku_uzupelnij(pamiec, klasa);
+        if (pamiec->listy[klasa] == NULL) {
+            return NULL;
+        }
+    }
+
+    void *obiekt = pamiec->listy[klasa];
+    pamiec->listy[klasa] = *(void **) obiekt;
+    pamiec->ile[klasa]--;
+
+    // Obiekt opuszcza pamięć podręczną - dla programu znów jest zajęty
+    struct slab_t *slab = indeks_slab(obiekt);
+    if (slab != NULL) {
+        size_t indeks = pamiec_watku_indeks_obiektu(slab, obiekt);
+        __atomic_fetch_and(&slab->mapa_podrecznych[indeks / 64], ~((uint64_t) 1 << (indeks % 64)), __ATOMIC_RELEASE);
+    } else {
+        struct memory_chunk_t *blok = (struct memory_chunk_t *) ((char *) obiekt - POCZATEK_DANYCH);
+        __atomic_fetch_and(&blok->wlasciciel, (uint8_t) ~WLASCICIEL_W_PAMIECI, __ATOMIC_RELEASE);
+    }
+
+    // Licznik przydziałów należy do wątku - jedyny piszący nie potrzebuje operacji niepodzielnej odczyt-zapis
+    atomic_size_t *przydzialy = &pamiec->przydzialy[statystyki_klasa(rozmiar)];
+    atomic_store_explicit(przydzialy, atomic_load_explicit(przydzialy, memory_order_relaxed) + 1, memory_order_relaxed);
+    return obiekt;
+}
+int pamiec_watku_zwolnij(void *blok_pamieci) {
+    // Zwraca 1 dla zwolnienia do pamięci wątku, -1 dla pominiętego zwolnienia obiektu pamięci wątku (ponownego albo
+    // z uszkodzonym płotkiem) i 0 dla wskaźnika, który obsługuje zwolnienie pod blokadą.
+    // Bez blokady odczytywane są tylko znaczniki indeksu, stałe pola i mapy slabu oraz bajt właściciela, wielkość
+    // i płotki bloku pamięci wątku - pozostałe pola nagłówka zmieniają się pod blokadą sterty także w zajętych blokach
+    if (biezaca_sterta != &glowna_sterta || blok_pamieci == NULL || memory_manager.strony_slabow == NULL ||
+        (char *) blok_pamieci < (char *) memory_manager.poczatek + POCZATEK_DANYCH) {
+        return 0;
+    }
+
+    // Obiekty slabów należących do miejsc pamięci wątków wracają do pamięci podręcznej właściciela
+    struct slab_t *slab = indeks_slab(blok_pamieci);
+    if (slab != NULL) {
+        return pamiec_watku_zwolnij_ze_slabu(slab, blok_pamieci);
+    }
+
+    // Nagłówek odczytywany jest tylko dla początku danych bloku pamięci wątku - pozostałe wskaźniki (także błędne)
+    // sprawdza zwolnienie pod blokadą
+    if (!indeks_podreczny(blok_pamieci)) {
+        return 0;
+    }
+
+    // Blok leżący już w pamięci podręcznej jest zwolniony - ponowne zwolnienie jest pomijane
+    struct memory_chunk_t *blok = (struct memory_chunk_t *) ((char *) blok_pamieci - POCZATEK_DANYCH);
+    uint8_t wlasciciel = kawalek_wlasciciel(blok);
+    if (wlasciciel == 0 || (wlasciciel & WLASCICIEL_MIEJSCE) > MAKS_PAMIECI_WATKOW) {
+        return 0;
+    }
+    if ((wlasciciel & WLASCICIEL_W_PAMIECI) != 0) {
+        return -1;
+    }
+    if (__atomic_load_n(&memory_manager.tryb_walidacji, __ATOMIC_RELAXED) != heap_validation_off &&
+        !sprawdzaj_plotka(blok)) {
+        return -1;
+    }
+
+    // Z równoczesnych zwolnień tego samego bloku oznaczenie udaje się tylko jednemu
+    if (!__atomic_compare_exchange_n(&blok->wlasciciel, &wlasciciel, (uint8_t) (wlasciciel | WLASCICIEL_W_PAMIECI), 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    pamiec_watku_przekaz(&pamieci_watkow[(wlasciciel & WLASCICIEL_MIEJSCE) - 1], blok_pamieci);
+    return 1;
+}
+void pamiec_watku_przekaz(struct pamiec_watku_t *wlasciciel, void *obiekt) {
+    size_t klasa = pamiec_watku_klasa_obiektu(obiekt);
+    if (wlasciciel == pamiec_tego_watku) {
+        // Zwolnienie we własnym wątku - nadmiar wraca porcją do wspólnej sterty
+        pamiec_watku_wloz(wlasciciel, obiekt, klasa);
+        if (wlasciciel->ile[klasa] > POJEMNOSC_KLASY_PAMIECI_WATKU) {
+            pamiec_watku_oddaj(wlasciciel, klasa, PORCJA_PAMIECI_WATKU);
+        }
+        return;
+    }
+
+    if (!atomic_load(&wlasciciel->zajeta)) {
+        // Wątek-właściciel zakończył się - obiekt wraca wprost do wspólnej sterty
+        ZABLOKUJ_STERTE();
+        pamiec_watku_zwroc(obiekt);
+        ODBLOKUJ_STERTE();
+        return;
+    }
+
+    // Zwolnienie z obcego wątku trafia do bezblokadowej kolejki właściciela
+    void *glowa = atomic_load_explicit(&wlasciciel->zdalne, memory_order_relaxed);
+    do {
+        *(void **) obiekt = glowa;
+    } while (!atomic_compare_exchange_weak_explicit(&wlasciciel->zdalne, &glowa, obiekt,
+                                                    memory_order_release, memory_order_relaxed));
+}
+void pamiec_watku_uzupelnij(struct pamiec_watku_t *pamiec, size_t klasa) {
+    size_t rozmiar = (klasa + 1) * KROK_KLASY_PAMIECI_WATKU;
+    uint8_t identyfikator = (uint8_t) (pamiec - pamieci_watkow + 1);
+
+    // Klasy o rozmiarze obiektu slabu uzupełniane są ze slabów miejsca - obiekty leżą wtedy co rozmiar_obiektu
+    // bajtów, bez nagłówka i płotków
+    int ze_slabu = memory_manager.slaby_wlaczone && rozmiar <= NAJWIEKSZY_OBIEKT_SLABU && (rozmiar & (rozmiar - 1)) == 0;
+
+    // Jedna walidacja i jedna blokada na całą porcję bloków
+    ZABLOKUJ_STERTE();
+    if (memory_manager.pierwszy_kawalek == NULL || walidacja_globalna() == 0) {
+        for (size_t i = 0; i < PORCJA_PAMIECI_WATKU; i++) {
+            if (ze_slabu) {
+                void *obiekt = slab_przydziel_z(slab_klasa(rozmiar), identyfikator);
+                if (obiekt == NULL) {
+                    break;
+                }
+                struct slab_t *slab = indeks_slab(obiekt);
+                size_t indeks = pamiec_watku_indeks_obiektu(slab, obiekt);
+                __atomic_fetch_or(&slab->mapa_podrecznych[indeks / 64], (uint64_t) 1 << (indeks % 64), __ATOMIC_RELEASE);
+                pamiec_watku_wloz(pamiec, obiekt, klasa);
+                continue;
+            }
+            void *dane = malloc_przydziel_blok(rozmiar);
+            if (dane == NULL) {
+                break;
+            }
+            struct memory_chunk_t *blok = (struct memory_chunk_t *) ((char *) dane - POCZATEK_DANYCH);
+            __atomic_store_n(&blok->wlasciciel, (uint8_t) (identyfikator | WLASCICIEL_W_PAMIECI), __ATOMIC_RELEASE);
+            indeks_oznacz_podreczny(blok, 1);
+            pamiec_watku_wloz(pamiec, dane, klasa);
+        }
+    }
+    ODBLOKUJ_STERTE();
+}
+void pamiec_watku_zwroc(void *obiekt) {
+    // Obiekt z pamięci podręcznej wraca do wspólnej sterty (pod blokadą) jako wolny obiekt slabu albo zwykły wolny blok
+    struct slab_t *slab = indeks_slab(obiekt);
+    if (slab != NULL) {
+        size_t indeks = pamiec_watku_indeks_obiektu(slab, obiekt);
+        __atomic_fetch_and(&slab->mapa_podrecznych[indeks / 64], ~((uint64_t) 1 << (indeks % 64)), __ATOMIC_RELAXED);
+        slab_zwolnij(slab, obiekt);
+        return;
+    }
+    struct memory_chunk_t *blok = (struct memory_chunk_t *) ((char *) obiekt - POCZATEK_DANYCH);
+    indeks_oznacz_podreczny(blok, 0);
+    __atomic_store_n(&blok->wlasciciel, 0, __ATOMIC_RELAXED);
+    free_zwolnij_blok(blok);
+}
+void pamiec_watku_oddaj(struct pamiec_watku_t *pamiec, size_t klasa, size_t ile) {
+    ZABLOKUJ_STERTE();
+    while (ile-- > 0 && pamiec->listy[klasa] != NULL) {
+        void *obiekt = pamiec->listy[klasa];
+        pamiec->listy[klasa] = *(void **) obiekt;
+        pamiec->ile[klasa]--;
+        pamiec_watku_zwroc(obiekt);
+    }
+    przycinanie_automatyczne();
+    ODBLOKUJ_STERTE();
+}
+void pamiec_watku_odbierz_zdalne(struct pamiec_watku_t *pamiec) {
+    // Przejęcie całej kolejki jedną operacją atomową
+    void *obiekt = atomic_exchange_explicit(&pamiec->zdalne, NULL, memory_order_acquire);
+    while (obiekt != NULL) {
+        void *nastepny = *(void **) obiekt;
+        pamiec_watku_wloz(pamiec, obiekt, pamiec_watku_klasa_obiektu(obiekt));
+        obiekt = nastepny;
+    }
+}
+void pamiec_watku_zakoncz(void *pamiec) {
+    // Zakończenie wątku: cała jego pamięć podręczna wraca do wspólnej sterty
+    struct pamiec_watku_t *pamiec_watku = (struct pamiec_watku_t *) pamiec;
+    pamiec_watku_odbierz_zdalne(pamiec_watku);
+    for (size_t klasa = 0; klasa < KLASY_PAMIECI_WATKU; klasa++) {
+        pamiec_watku_oddaj(pamiec_watku, klasa, pamiec_watku->ile[klasa]);
+    }
+
+    // Puste slaby miejsca wracają na stertę; slaby z obiektami w użyciu czekają na następny wątek w tym miejscu
+    ZABLOKUJ_STERTE();
+    for (size_t klasa = 0; klasa < KLASY_SLABOW; klasa++) {
+        struct slab_t *slab = pamiec_watku->slaby[klasa];
+        while (slab != NULL) {
+            struct slab_t *nastepny = slab_nastepny(slab);
+            if (slab->wolne == slab->pojemnosc) {
+                slab_zniszcz(slab);
+            }
+            slab = nastepny;
+        }
+    }
+    ODBLOKUJ_STERTE();
+    pamiec_tego_watku = NULL;
+    atomic_store(&pamiec_watku->zajeta, 0);
+}
+void pamiec_watku_wyczysc_wszystkie(void) {
+    // Po heap_clean bloki w pamięciach wątków przestają istnieć; wątki zachowują swoje miejsca
+    for (size_t i = 0; i < MAKS_PAMIECI_WATKOW; i++) {
+        memset(pamieci_watkow[i].listy, 0, sizeof(pamieci_watkow[i].listy));
+        memset(pamieci_watkow[i].ile, 0, sizeof(pamieci_watkow[i].ile));
+        memset(pamieci_watkow[i].slaby, 0, sizeof(pamieci_watkow[i].slaby));
+        atomic_store(&pamieci_watkow[i].zdalne, NULL);
+        for (size_t klasa = 0; klasa < HEAP_STATS_CLASSES; klasa++) {
+            atomic_store(&pamieci_watkow[i].przydzialy[klasa], 0);
+        }
+    }
+}
+struct slab_t **pamiec_watku_lista_slabow(uint8_t wlasciciel, size_t klasa) {
+    return &pamieci_watkow[wlasciciel - 1].slaby[klasa];
+}
+void pamiec_watku_zlicz_przydzialy(size_t *przydzialy) {
+    // Przydziały z pamięci podręcznych wszystkich miejsc, także zwolnionych przez zakończone wątki
+    for (size_t i = 0; i < MAKS_PAMIECI_WATKOW; i++) {
+        for (size_t klasa = 0; klasa < HEAP_STATS_CLASSES; klasa++) {
+            przydzialy[klasa] += atomic_load_explicit(&pamieci_watkow[i].przydzialy[klasa], memory_order_relaxed);
+        }
+    }
 }
+#endif
@@ -5,21 +5,378 @@
 #include <stddef.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "custom_unistd.h"
+
+#ifdef HEAP_THREAD_SAFE
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
+#define LICZBA_KOSZY 256
+
+// Wyrównanie danych każdego bloku zwracanego przez heap_malloc
+#define WYROWNANIE 16
+
+enum heap_validation_t {
+    heap_validation_off,
+    heap_validation_local,
+    heap_validation_sampled,
+    heap_validation_full
+};
+
+// Domyślny tryb walidacji ustalany przy kompilacji, zmieniany w czasie działania przez heap_configure
+#ifndef HEAP_VALIDATION
+#define HEAP_VALIDATION heap_validation_full
+#endif
+
+// Polityka wyboru wolnego bloku: good fit to pierwszy blok z najmniejszego kosza, którego każdy blok
+// zmieści żądanie; first fit i best fit przeglądają też kosz samego rozmiaru, next fit - listę bloków od ostatniego trafienia
+enum heap_placement_t {
+    heap_placement_good_fit,
+    heap_placement_first_fit,
+    heap_placement_next_fit,
+    heap_placement_best_fit
+};
+
+#ifndef HEAP_PLACEMENT
+#define HEAP_PLACEMENT heap_placement_good_fit
+#endif
+
+// Co ile operacji tryb sampled wykonuje pełną walidację sterty
+#ifndef HEAP_VALIDATION_PERIOD
+#define HEAP_VALIDATION_PERIOD 64
+#endif
+
+// Czy małe żądania obsługuje domyślnie alokator płytowy (slab). Obiekty slabów nie mają płotków, więc
+// heap_validate, get_pointer_type i heap_scrub nie wykrywają przepełnienia obiektu do 256 bajtów - przy pełnej
+// walidacji slaby są domyślnie wyłączone, a heap_configure(heap_option_slabs, 1) włącza je świadomie
+#ifndef HEAP_SLABS
+#define HEAP_SLABS (HEAP_VALIDATION != heap_validation_full)
+#endif
+
+// Od jakiego rozmiaru bloki dostają własne odwzorowanie mmap zamiast miejsca na stercie (0 wyłącza)
+#ifndef HEAP_MMAP_THRESHOLD
+#define HEAP_MMAP_THRESHOLD (128 * 1024)
+#endif
+
+// Od jakiej wielkości wolnego końca sterty heap_free oddaje go przez custom_sbrk (0 wyłącza)
+#ifndef HEAP_TRIM_THRESHOLD
+#define HEAP_TRIM_THRESHOLD (128 * 1024)
+#endif
+
+// O ile najmniej rośnie sterta, gdy brakuje miejsca (0 - dokładnie o brakującą część); kolejne przyrosty
+// podwajają się aż do HEAP_GROWTH_MAX, a niewykorzystana część zostaje wolnym blokiem na końcu sterty
+#ifndef HEAP_GROWTH_MIN
+#define HEAP_GROWTH_MIN (64 * 1024)
+#endif
+
+// Największy przyrost sterty - większe żądania powiększają ją dokładnie o brakującą część
+#ifndef HEAP_GROWTH_MAX
+#define HEAP_GROWTH_MAX (1024 * 1024)
+#endif
+
+// Ile pamięci rezerwuje heap_create, gdy nie podano pojemności (strony dostają pamięć przy pierwszym zapisie)
+#ifndef HEAP_DEFAULT_CAPACITY
+#define HEAP_DEFAULT_CAPACITY ((size_t) 1 << 30)
+#endif
+
+// Ile stron (po ROZMIAR_STRONY bajtów) sterty obejmuje indeks adresów - bloki dalej szukane są przez listę
+#ifndef HEAP_INDEX_PAGES
+#define HEAP_INDEX_PAGES ((size_t) 1 << 20)
+#endif
+
+// Liczba klas rozmiaru w statystykach przydziałów - klasa i obejmuje żądania od 2^i do 2^(i+1)-1 bajtów
+#define HEAP_STATS_CLASSES 32
+
+// Liczba przedziałów histogramów czasu (log2 liczby cykli), zbieranych po zdefiniowaniu HEAP_STATS_LATENCY
+#define HEAP_STATS_LATENCY_BUCKETS 32
+
+struct heap_stats_t {
+    size_t heap_size;
+    size_t bytes_in_use;
+    size_t bytes_free;
+    size_t used_chunks;
+    size_t free_chunks;
+    size_t largest_free_block;
+    size_t mmap_blocks;
+    size_t mmap_bytes;
+    size_t sbrk_calls;
+    size_t realloc_in_place;
+    size_t realloc_moved;
+    size_t allocations[HEAP_STATS_CLASSES];
+    uint64_t malloc_latency[HEAP_STATS_LATENCY_BUCKETS];
+    uint64_t free_latency[HEAP_STATS_LATENCY_BUCKETS];
+    uint64_t realloc_latency[HEAP_STATS_LATENCY_BUCKETS];
+};
+
+// Zapis śladu operacji: nagłówek pliku, a po nim zdarzenia heap_trace_event_t w kolejności wykonania
+#define HEAP_TRACE_MAGIC 0x43525448u
+#define HEAP_TRACE_VERSION 1
+
+enum heap_trace_operation_t {
+    heap_trace_malloc,
+    heap_trace_calloc,
+    heap_trace_realloc,
+    heap_trace_free
+};
+
+struct heap_trace_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t event_size;
+    uint32_t reserved;
+};
+
+// Identyfikatorem obiektu jest jego adres - jest jednoznaczny wśród obiektów żywych w danej chwili;
+// realloc zapisuje stary identyfikator w id, a nowy w result, pozostałe operacje tylko id
+struct heap_trace_event_t {
+    uint32_t operation;
+    uint32_t thread;
+    uint64_t timestamp;
+    uint64_t size;
+    uint64_t id;
+    uint64_t result;
+};
+
+// Liczba zdarzeń buforowanych w pamięci przed zapisem do pliku śladu
+#ifndef HEAP_TRACE_BUFFER
+#define HEAP_TRACE_BUFFER 1024
+#endif
+
+enum heap_option_t {
+    heap_option_validation,
+    heap_option_validation_period,
+    heap_option_slabs,
+    heap_option_mmap_threshold,
+    heap_option_trim_threshold,
+    heap_option_placement,
+    heap_option_growth_min,
+    heap_option_growth_max
+};
+
+// Rodzaje uszkodzeń zgłaszanych przez heap_scrub: suma kontrolna nagłówka, znaczniki graniczne (flaga wolnego
+// poprzednika lub stopka wolnego bloku), płotek zajętego bloku albo nagłówek slabu
+enum heap_damage_t {
+    heap_damage_none,
+    heap_damage_checksum,
+    heap_damage_boundary_tag,
+    heap_damage_fence,
+    heap_damage_slab
+};
+typedef void (*heap_scrub_callback_t)(void* chunk, enum heap_damage_t damage, void* arg);
+
+#define ROZMIAR_SLABU 4096
+#define KLASY_SLABOW 5
+#define NAJMNIEJSZY_OBIEKT_SLABU 16
+#define NAJWIEKSZY_OBIEKT_SLABU 256
+#define ROZMIAR_STRONY 4096
+
+// Kopia tablicy heap_free_batch porządkowana jest na stosie do tej liczby wskaźników, a dla większych porcji
+// w pamięci odwzorowanej przez mmap
+#define BUFOR_ZWALNIANIA_WSADOWEGO 256
+
+#ifdef HEAP_THREAD_SAFE
+// Histogramy czasu uzupełniane są także poza blokadą (w ścieżkach pamięci podręcznej wątku)
+typedef atomic_uint_least64_t licznik_czasu_t;
+#else
+typedef uint64_t licznik_czasu_t;
+#endif
+
+// Liczniki aktualizowane przy zmianach stanu bloków - heap_stats nie przechodzi listy bloków
+struct statystyki_t {
+    size_t bloki;
+    size_t wolne_bloki;
+    size_t wolne_bajty;
+    size_t bloki_mmap;
+    size_t bajty_mmap;
+    size_t wywolania_sbrk;
+    size_t realloc_w_miejscu;
+    size_t realloc_przeniesione;
+    size_t przydzialy[HEAP_STATS_CLASSES];
+#ifdef HEAP_STATS_LATENCY
+    licznik_czasu_t czas_malloc[HEAP_STATS_LATENCY_BUCKETS];
+    licznik_czasu_t czas_free[HEAP_STATS_LATENCY_BUCKETS];
+    licznik_czasu_t czas_realloc[HEAP_STATS_LATENCY_BUCKETS];
+#endif
+};
+
+// Obszar sterty utworzonej przez heap_create lub heap_open, w którym przesuwana jest jej własna granica;
+// sterta główna nie ma obszaru (poczatek == NULL) i rośnie przez custom_sbrk, a obszar sterty z heap_open
+// odwzorowuje plik (plik != 0)
+struct obszar_sterty_t {
+    char *poczatek;
+    size_t pojemnosc;
+    size_t granica;
+    char *czyste_od;
+    int plik;
+};
 
 struct memory_manager_t {
+    struct obszar_sterty_t obszar;
     void *poczatek;
     size_t wielkosc_pamieci;
     struct memory_chunk_t *pierwszy_kawalek;
+    struct memory_chunk_t *ostatni_kawalek;
+    struct memory_chunk_t *kosze[LICZBA_KOSZY];
+    uint64_t mapa_koszy[LICZBA_KOSZY / 64];
+    enum heap_validation_t tryb_walidacji;
+    size_t okres_walidacji;
+    size_t licznik_operacji;
+    int slaby_wlaczone;
+    struct slab_t *slaby[KLASY_SLABOW];
+    struct memory_chunk_t *duze_bloki;
+    size_t prog_mmap;
+    size_t prog_przycinania;
+    size_t przyrost_min;
+    size_t przyrost_max;
+    size_t przyrost;
+    size_t rezerwa;
+    enum heap_placement_t polityka_rozmieszczenia;
+    struct memory_chunk_t *wedrowny;
+    struct memory_chunk_t **indeks_stron;
+    uint64_t *indeks_mapa;
+    uint64_t *indeks_podsumowanie;
+    uint8_t *strony_slabow;
+    uint64_t *bloki_podreczne;
+    struct statystyki_t statystyki;
+    int odroczone_sprawdzenie;
+    intptr_t korzen;
+    struct memory_chunk_t *skaner;
+    heap_scrub_callback_t zgloszenie;
+    void *zgloszenie_argument;
+#ifdef HEAP_THREAD_SAFE
+    pthread_mutex_t blokada;
+    int blokada_gotowa;
+#endif
+};
+
+// Plik sterty (heap_open): nagłówek z menedżerem sterty na pierwszych stronach, a za nim cały obszar sterty;
+// otwierany jest tylko plik zapisany przez alokator w tej samej konfiguracji (układ bloków i menedżera)
+#define MAGIA_PLIKU_STERTY 0x50414548u
+#define WERSJA_PLIKU_STERTY 2
+struct plik_sterty_t {
+    uint32_t magia;
+    uint32_t wersja;
+    uint32_t wielkosc_naglowka_bloku;
+    uint32_t wielkosc_menedzera;
+    size_t pojemnosc;
+    struct memory_manager_t sterta;
+};
+#define NAGLOWEK_PLIKU_STERTY ((sizeof(struct plik_sterty_t) + ROZMIAR_STRONY - 1) & ~(size_t) (ROZMIAR_STRONY - 1))
+
+#ifdef HEAP_COMPACT_HEADER
+// Zwarty nagłówek (16 bajtów): sąsiedzi jako 32-bitowe przesunięcia od początku sterty w jednostkach WYROWNANIE
+// (0 oznacza brak sąsiada), a 32-bitowa wielkość, flagi, właściciel i skrócona suma kontrolna w jednym słowie
+#define BITY_SUMY_KONTROLNEJ 16
+struct memory_chunk_t {
+    uint32_t poprzedni_przesuniecie;
+    uint32_t nastepny_przesuniecie;
+    uint32_t wielkosc;
+    uint8_t czy_wolny : 1;
+    uint8_t poprzedni_wolny : 1;
+    uint8_t rodzaj : 2;
+    uint8_t wlasciciel;
+    uint16_t checksuma;
 };
 
+// 32-bitowa wielkość ogranicza rozmiar bloku i całej sterty (obszar wolnego bloku może objąć prawie całą stertę)
+#define NAJWIEKSZY_ROZMIAR_BLOKU ((size_t) UINT32_MAX + 1 - ROZMIAR_STRONY)
+#define NAJWIEKSZA_STERTA ((size_t) UINT32_MAX + 1 - ROZMIAR_STRONY)
+
+// Blok mapowany leży poza stertą - jego sąsiedzi na liście duze_bloki zapisani są tuż przed nagłówkiem
+struct powiazania_mmap_t {
+    struct memory_chunk_t *poprzedni;
+    struct memory_chunk_t *nastepny;
+};
+#define PRZEDROSTEK_MMAP sizeof(struct powiazania_mmap_t)
+#else
+// Sąsiedzi zapisani jako przesunięcia względem samego bloku (0 oznacza brak sąsiada) - sterta nie zależy od adresu,
+// pod którym leży
 struct memory_chunk_t {
-    struct memory_chunk_t* poprzedni;
-    struct memory_chunk_t* nastepny;
+    intptr_t poprzedni_przesuniecie;
+    intptr_t nastepny_przesuniecie;
     size_t wielkosc;
-    int czy_wolny;
+    uint8_t czy_wolny;
+    uint8_t poprzedni_wolny;
+    uint8_t rodzaj;
+    uint8_t wlasciciel;
     int checksuma;
 };
 
+#define PRZEDROSTEK_MMAP 0
+#endif
+
+#define KAWALEK_POPRZEDNI(blok) kawalek_poprzedni(blok)
+#define KAWALEK_NASTEPNY(blok) kawalek_nastepny(blok)
+#define KAWALEK_USTAW_POPRZEDNI(blok, wartosc) kawalek_ustaw_poprzedni((blok), (wartosc))
+#define KAWALEK_USTAW_NASTEPNY(blok, wartosc) kawalek_ustaw_nastepny((blok), (wartosc))
+
+// Rodzaje bloków - blok płytowy przechowuje w swoich danych slab z małymi obiektami,
+// a blok mapowany leży poza stertą we własnym odwzorowaniu mmap (na liście duze_bloki)
+#define RODZAJ_ZWYKLY 0
+#define RODZAJ_SLAB 1
+#define RODZAJ_MMAP 2
+
+// Bajt właściciela bloku pamięci podręcznej wątku: numer miejsca w tablicy pamięci wątków (od 1) i bit bloku
+// leżącego w pamięci podręcznej lub w kolejce zwolnień (zwolnionego z punktu widzenia programu); zmienia się bez
+// blokady sterty, więc nie jest objęty sumą kontrolną nagłówka
+#define WLASCICIEL_MIEJSCE 0x7f
+#define WLASCICIEL_W_PAMIECI 0x80
+
+// Nagłówek slabu, umieszczony na początku wyrównanego do ROZMIAR_SLABU obszaru danych bloku;
+// sąsiednie slaby listy i blok płytowy zapisane są jako przesunięcia względem slabu;
+// slab z właścicielem (miejscem pamięci wątku) uzupełnia tylko jej pamięć podręczną, a mapa_podrecznych
+// wskazuje jego obiekty leżące w pamięci podręcznej lub w kolejce zwolnień
+#define MAGIA_SLABU 0x534c4142u
+struct slab_t {
+    uint32_t magia;
+    uint16_t klasa;
+    uint16_t wolne;
+    uint16_t pojemnosc;
+    uint16_t rozmiar_obiektu;
+    uint8_t wlasciciel;
+    intptr_t poprzedni;
+    intptr_t nastepny;
+    intptr_t kawalek;
+    uint64_t mapa_wolnych[ROZMIAR_SLABU / NAJMNIEJSZY_OBIEKT_SLABU / 64];
+    uint64_t mapa_podrecznych[ROZMIAR_SLABU / NAJMNIEJSZY_OBIEKT_SLABU / 64];
+};
+
+// Powiązania listy wolnych bloków, przechowywane w obszarze danych wolnego bloku;
+// ostatnie bajty obszaru wolnego bloku zajmuje stopka z jego wielkością (znacznik graniczny);
+// sąsiedzi w koszu zapisani są jako przesunięcia względem bloku
+struct wolny_kawalek_t {
+    intptr_t poprzedni_wolny;
+    intptr_t nastepny_wolny;
+};
+
+#ifdef HEAP_THREAD_SAFE
+#define KLASY_PAMIECI_WATKU 32
+#define KROK_KLASY_PAMIECI_WATKU 16
+#define POJEMNOSC_KLASY_PAMIECI_WATKU 64
+#define PORCJA_PAMIECI_WATKU 16
+#define MAKS_PAMIECI_WATKOW 64
+
+// Pamięć podręczna wątku: obiekty slabów i bloki zajęte z punktu widzenia sterty, powiązane przez pierwsze bajty
+// danych; klasa i przechowuje obiekty o pojemności (i + 1) * KROK_KLASY_PAMIECI_WATKU bajtów, a slaby miejsca
+// z wolnymi obiektami tworzą jego własne listy (zmieniane pod blokadą sterty)
+struct pamiec_watku_t {
+    void *listy[KLASY_PAMIECI_WATKU];
+    size_t ile[KLASY_PAMIECI_WATKU];
+    _Atomic(void *) zdalne;
+    struct slab_t *slaby[KLASY_SLABOW];
+    atomic_size_t przydzialy[HEAP_STATS_CLASSES];
+    atomic_int zajeta;
+};
+#endif
+
 enum pointer_type_t {
     pointer_null,
     pointer_heap_corrupted,
@@ -30,44 +387,259 @@ enum pointer_type_t {
     pointer_valid
 };
 
-struct memory_manager_t memory_manager;
+typedef struct memory_manager_t heap_t;
+
+// Funkcje heap_* działają na bieżącej stercie wątku - głównej albo wskazanej w wywołaniu heap_*_in
+extern struct memory_manager_t glowna_sterta;
+extern _Thread_local struct memory_manager_t *biezaca_sterta;
+#define memory_manager (*biezaca_sterta)
 
+// heap_setup, heap_clean, heap_reset i heap_destroy zmieniają stertę bez jej blokady - w trybie HEAP_THREAD_SAFE
+// inne wątki nie mogą w tym czasie korzystać z tej sterty
 int heap_setup(void);
 void heap_clean(void);
 void* heap_malloc(size_t size);
 void* heap_calloc(size_t liczba, size_t ile);
+void* heap_aligned_alloc(size_t alignment, size_t size);
+int heap_posix_memalign(void** memptr, size_t alignment, size_t size);
 void* heap_realloc(void* memblock, size_t count);
 void heap_free(void* memblock);
+void heap_free_sized(void* memblock, size_t size);
+void* heap_realloc_sized(void* memblock, size_t old_size, size_t count);
+size_t heap_malloc_batch(size_t n, const size_t* sizes, void** out);
+// Tablica ptrs nie jest zmieniana - porządkowana jest jej kopia
+void heap_free_batch(void* const* ptrs, size_t n);
 int heap_validate(void);
 size_t heap_get_largest_used_block_size(void);
 enum pointer_type_t get_pointer_type(const void* const pointer);
+int heap_configure(enum heap_option_t option, size_t value);
+int heap_trim(size_t keep);
+int heap_reserve(size_t size);
+int heap_stats(struct heap_stats_t* stats);
+int heap_trace_start(const char* path);
+int heap_trace_stop(void);
+heap_t* heap_create(size_t capacity);
+void heap_destroy(heap_t* heap);
+int heap_reset(heap_t* heap);
+heap_t* heap_open(const char* path, size_t capacity);
+int heap_sync(heap_t* heap);
+int heap_set_root(heap_t* heap, void* root);
+void* heap_get_root(heap_t* heap);
+void heap_scrub_set_callback(heap_scrub_callback_t callback, void* arg);
+size_t heap_scrub(size_t budget);
+#ifdef HEAP_THREAD_SAFE
+int heap_scrub_start(heap_t* heap, size_t budget, unsigned interval_ms);
+void heap_scrub_stop(void);
+#endif
+void* heap_malloc_in(heap_t* heap, size_t size);
+void* heap_calloc_in(heap_t* heap, size_t number, size_t size);
+void* heap_realloc_in(heap_t* heap, void* memblock, size_t count);
+void heap_free_in(heap_t* heap, void* memblock);
 
 
 //POMOCNICZE
 int oblicz_checksuma(struct memory_chunk_t *memory_block);
+size_t obszar_bloku(struct memory_chunk_t *blok);
+void *wywolaj_sbrk(intptr_t zmiana);
+intptr_t przesuniecie_wzgledne(const void *od, const void *cel);
+void *adres_wzgledny(const void *od, intptr_t przesuniecie);
+
+//NAGLOWEK
+#ifdef HEAP_COMPACT_HEADER
+struct memory_chunk_t *kawalek_z_przesuniecia(uint32_t przesuniecie);
+uint32_t kawalek_przesuniecie(const struct memory_chunk_t *blok);
+struct powiazania_mmap_t *kawalek_powiazania_mmap(const struct memory_chunk_t *blok);
+#endif
+struct memory_chunk_t *kawalek_poprzedni(const struct memory_chunk_t *blok);
+struct memory_chunk_t *kawalek_nastepny(const struct memory_chunk_t *blok);
+void kawalek_ustaw_poprzedni(struct memory_chunk_t *blok, struct memory_chunk_t *poprzedni);
+void kawalek_ustaw_nastepny(struct memory_chunk_t *blok, struct memory_chunk_t *nastepny);
+uint8_t kawalek_wlasciciel(const struct memory_chunk_t *blok);
+int kawalek_w_pamieci_watku(const struct memory_chunk_t *blok);
+
+//STERTY
+struct memory_manager_t *sterta_wybierz(heap_t *sterta);
+int sterta_obejmuje(const void *wskaznik);
+void *sterta_sbrk(intptr_t zmiana);
+char **sterta_czysta_pamiec(void);
+
+//PLIK
+void *plik_przesun(void *wskaznik, intptr_t roznica);
+void plik_przenies(intptr_t roznica);
+int plik_dokoncz_otwarcie(void);
+
+//STATYSTYKI
+size_t statystyki_klasa(size_t rozmiar);
+void statystyki_przydzial(size_t rozmiar);
+#ifdef HEAP_STATS_LATENCY
+uint64_t statystyki_czas(void);
+void statystyki_zapisz_czas(licznik_czasu_t *histogram, uint64_t cykle);
+#endif
+
+//ZNACZNIKI
+size_t *znacznik_stopka(struct memory_chunk_t *blok);
+struct memory_chunk_t *znacznik_nastepny(struct memory_chunk_t *blok);
+struct memory_chunk_t *znacznik_poprzedni_wolny(struct memory_chunk_t *blok);
+void znacznik_ustaw(struct memory_chunk_t *blok, int wolny);
+
+//KOSZE
+size_t kosz_indeks(size_t wielkosc);
+struct wolny_kawalek_t *kosz_powiazania(struct memory_chunk_t *blok);
+struct memory_chunk_t *kosz_poprzedni(struct memory_chunk_t *blok);
+struct memory_chunk_t *kosz_nastepny(struct memory_chunk_t *blok);
+void kosze_wstaw(struct memory_chunk_t *blok);
+void kosze_usun(struct memory_chunk_t *blok);
+size_t kosze_nastepny_niepusty(size_t start);
+struct memory_chunk_t *kosze_znajdz(size_t potrzeba);
+struct memory_chunk_t *kosze_znajdz_pierwszy(size_t potrzeba);
+struct memory_chunk_t *kosze_znajdz_najlepszy(size_t potrzeba);
+size_t kosze_najwiekszy_wolny(void);
+
+//ROZMIESZCZENIE
+struct memory_chunk_t *rozmieszczenie_znajdz(size_t potrzeba);
+struct memory_chunk_t *rozmieszczenie_nastepne_dopasowanie(size_t potrzeba);
+
+//CALLOC
+size_t calloc_brudne_bajty(void *wskaznik, size_t rozmiar, const char *czyste_od);
+void calloc_oznacz_zapisane(char *koniec);
+void calloc_oznacz_wydany(struct memory_chunk_t *blok);
 
 //MALLOC
+void *malloc_wykonaj(size_t rozmiar);
+void *malloc_przydziel(size_t rozmiar);
+int malloc_zwykly_blok(size_t rozmiar);
+void *malloc_przydziel_blok(size_t rozmiar);
+void *malloc_przydziel_z_kosza(struct memory_chunk_t *blok, size_t rozmiar);
+void *malloc_zajmij_blok(struct memory_chunk_t *blok, size_t rozmiar);
 void *malloc_alokuj_poczatkowy_blok_pamieci(size_t rozmiar);
-void *malloc_znajdz_najlepsze_dopasowanie_lub_rozszerz_pamiec(size_t size, struct memory_chunk_t *blok);
-void malloc_inicjalizuj_nowy_blok(struct memory_chunk_t *blok, struct memory_chunk_t *nowy_blok, size_t rozmiar);
-void *malloc_rozszerz_pamiec(size_t size, struct memory_chunk_t *blok);
+size_t malloc_wymagany_obszar(size_t rozmiar);
+void *malloc_znajdz_dopasowanie_lub_rozszerz_pamiec(size_t size);
+void *malloc_rozszerz_pamiec(size_t size);
+struct memory_chunk_t *malloc_rozszerz_o_wolny_blok(size_t obszar);
+void *malloc_przydziel_wyrownany(size_t wyrownanie, size_t rozmiar);
+size_t malloc_przesuniecie_wyrownania(char *miejsce_bloku, size_t wyrownanie);
+struct memory_chunk_t *podziel_blok(struct memory_chunk_t *blok, size_t obszar);
 void malloc_inicjalizuj_blok_pamieci(struct memory_chunk_t *blok);
 
 //REALLOC
+void realloc_policz(void *stary_blok, void *nowy_blok);
+void *realloc_wykonaj(void *blok_pamieci, size_t rozmiar);
+void *realloc_rozmiar_wykonaj(void *blok_pamieci, size_t stary_rozmiar, size_t rozmiar);
+void *realloc_zmien(void *blok_pamieci, size_t rozmiar, struct slab_t *slab);
 int realloc_sprawdz_warunki_poczatkowe(void *blok_pamieci, size_t rozmiar);
-void *realloc_zdecyduj(void *blok_pamieci, size_t nowy_rozmiar, struct memory_chunk_t *aktualny_blok, struct memory_chunk_t *nastepny_blok);
-void realloc_dostosuj_bloki_pamieci(struct memory_chunk_t *blok_pamieci, struct memory_chunk_t *nastepny_blok_pamieci, size_t nowy_rozmiar);
+void *realloc_zdecyduj(void *blok_pamieci, size_t nowy_rozmiar, struct memory_chunk_t *aktualny_blok);
+size_t realloc_obszar_z_zapasem(size_t rozmiar);
+void *realloc_rozszerz(void *blok_pamieci, size_t rozmiar, struct memory_chunk_t *aktualny_blok);
+void realloc_wchlon_nastepny(struct memory_chunk_t *blok);
+struct memory_chunk_t *realloc_wchlon_poprzedni(struct memory_chunk_t *blok);
 void *realloc_przydziel_nowy_blok(struct memory_chunk_t *kawalek_pamieci, size_t rozmiar);
-void *realloc_rozszerz_w_miejscu(void *blok_pamieci, size_t rozmiar, struct memory_chunk_t *aktualny_blok, struct memory_chunk_t *nastepny_blok);
-void *realloc_zmniejsz(void *blok_pamieci, size_t nowy_rozmiar, struct memory_chunk_t *kawalek_pamieci);
-void *realloc_rozszerz_z_sbrk(struct memory_chunk_t *memory_block, size_t count);
+void *realloc_ustaw_rozmiar(void *blok_pamieci, size_t nowy_rozmiar, struct memory_chunk_t *kawalek_pamieci);
 
 //VALIDATE
 int sprawdzaj_plotka(struct memory_chunk_t *kawalek);
+int walidacja_pelna(void);
+enum pointer_type_t wskaznik_okresl_typ(const void *wskaznik);
+int walidacja_globalna(void);
+int walidacja_lokalna(struct memory_chunk_t *kawalek);
+int walidacja_bloku(struct memory_chunk_t *kawalek);
 
 //FREE
+void free_wykonaj(void *blok_pamieci);
+int free_zwolnij_wskaznik(void *blok_pamieci);
+void free_rozmiar_wykonaj(void *blok_pamieci, size_t rozmiar);
+int free_zwolnij_znany(void *blok_pamieci, size_t rozmiar);
+void free_zwolnij_blok(struct memory_chunk_t *aktualny_blok);
 void free_scal_z_poprzednim(struct memory_chunk_t **aktualny_blok);
 void free_scal_z_nastepnym(struct memory_chunk_t *aktualny_blok);
 
+//ROZMIAR
+int rozmiar_sprawdzany(void);
+int rozmiar_zgodny(void *blok_pamieci, size_t rozmiar);
+
+//WSADOWO
+int wsadowo_porownaj_adresy(const void *a, const void *b);
+int wsadowo_zwolnij(void *wskaznik);
+void wsadowo_przydziel_zalegle(size_t n, const size_t *rozmiary, void **wyniki, size_t obszar);
+
+//INDEKS
+size_t indeks_rozmiar(void);
+void indeks_utworz(void);
+void indeks_zwolnij(void);
+size_t indeks_strona(const void *wskaznik);
+size_t indeks_strona_slabu(const void *wskaznik);
+void indeks_oznacz_slab(struct slab_t *slab, uint8_t znacznik);
+struct slab_t *indeks_slab(const void *wskaznik);
+void indeks_oznacz_podreczny(struct memory_chunk_t *blok, int znacznik);
+int indeks_podreczny(const void *wskaznik);
+void indeks_dodaj(struct memory_chunk_t *blok);
+void indeks_usun(struct memory_chunk_t *blok);
+struct memory_chunk_t *indeks_znajdz(const void *wskaznik);
+size_t indeks_poprzednia_strona(size_t strona);
+
+//WZROST
+size_t wzrost_dopisz(size_t chciany, size_t minimalny);
+size_t wzrost_rozszerz(size_t brakuje);
+
+//PRZYCINANIE
+size_t przycinanie_wykonaj(size_t zostaw);
+void przycinanie_automatyczne(void);
+
+//SKANER
+enum heap_damage_t skaner_sprawdz(struct memory_chunk_t *kawalek);
+struct memory_chunk_t *skaner_nastepny(struct memory_chunk_t *kawalek);
+
+//SLAD
+int slad_aktywny(void);
+void slad_zapisz(enum heap_trace_operation_t operacja, size_t rozmiar, const void *obiekt, const void *wynik);
+int slad_oproznij(void);
+void *slad_malloc(size_t rozmiar);
+void *slad_calloc(size_t liczba, size_t ile);
+void *slad_realloc(void *blok_pamieci, size_t rozmiar);
+void *slad_aligned_alloc(size_t wyrownanie, size_t rozmiar);
+void slad_free(void *blok_pamieci);
+
+//MMAP
+size_t mmap_rozmiar_mapowania(size_t rozmiar);
+void *mmap_przydziel(size_t rozmiar);
+struct memory_chunk_t *mmap_znajdz(const void *wskaznik);
+void mmap_zwolnij(struct memory_chunk_t *blok);
+void *mmap_zmien_rozmiar(struct memory_chunk_t *blok, size_t rozmiar);
+void mmap_dolacz_sasiadow(struct memory_chunk_t *blok);
+
+//SLAB
+size_t slab_klasa(size_t rozmiar);
+size_t slab_poczatek_obiektow(void);
+struct slab_t *slab_poprzedni(struct slab_t *slab);
+struct slab_t *slab_nastepny(struct slab_t *slab);
+struct memory_chunk_t *slab_kawalek(struct slab_t *slab);
+struct slab_t **slab_lista(size_t klasa, uint8_t wlasciciel);
+void slab_wstaw(struct slab_t *slab);
+void slab_usun(struct slab_t *slab);
+struct slab_t *slab_utworz(size_t klasa, uint8_t wlasciciel);
+void *slab_przydziel(size_t rozmiar);
+void *slab_przydziel_z(size_t klasa, uint8_t wlasciciel);
+struct slab_t *slab_znajdz(const void *wskaznik);
+int slab_zwolnij(struct slab_t *slab, void *wskaznik);
+void slab_zniszcz(struct slab_t *slab);
+int slab_obiekt_w_pamieci_watku(struct slab_t *slab, size_t indeks);
+int slab_sprawdz(struct memory_chunk_t *kawalek);
+enum pointer_type_t slab_okresl_typ(struct slab_t *slab, const void *wskaznik);
+size_t slab_najwiekszy_zajety(struct memory_chunk_t *kawalek);
+
+#ifdef HEAP_THREAD_SAFE
+//PAMIEC WATKU
+struct pamiec_watku_t *pamiec_watku_pobierz(void);
+void *pamiec_watku_przydziel(size_t rozmiar);
+int pamiec_watku_zwolnij(void *blok_pamieci);
+void pamiec_watku_przekaz(struct pamiec_watku_t *wlasciciel, void *obiekt);
+void pamiec_watku_uzupelnij(struct pamiec_watku_t *pamiec, size_t klasa);
+void pamiec_watku_zwroc(void *obiekt);
+void pamiec_watku_oddaj(struct pamiec_watku_t *pamiec, size_t klasa, size_t ile);
+void pamiec_watku_odbierz_zdalne(struct pamiec_watku_t *pamiec);
+struct slab_t **pamiec_watku_lista_slabow(uint8_t wlasciciel, size_t klasa);
+void pamiec_watku_zakoncz(void *pamiec);
+void pamiec_watku_wyczysc_wszystkie(void);
+void pamiec_watku_zlicz_przydzialy(size_t *przydzialy);
+#endif
 
 #endif //BADAQU_HEAP_H
@@ -0,0 +1,87 @@
+#ifndef BADAQU_HEAP_PMR_HPP
+#define BADAQU_HEAP_PMR_HPP
+
+// Adaptery C++17 dla sterty głównej: std::pmr::memory_resource i alokator w stylu STL.
+// Zwalniają pamięć przez heap_free_sized, bo kontenery znają rozmiar zwalnianego obszaru.
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+// heap.h korzysta z konstrukcji C11 - C++ dostaje tylko deklaracje używanych funkcji
+extern "C" {
+void* heap_malloc(size_t size);
+void* heap_aligned_alloc(size_t alignment, size_t size);
+void heap_free_sized(void* memblock, size_t size);
+}
+
+namespace heap {
+
+// Wyrównanie zapewniane przez heap_malloc (WYROWNANIE w heap.h)
+inline constexpr std::size_t wyrownanie = 16;
+
+// Pusty obszar zajmuje 1 bajt, tak samo przy przydziale i zwolnieniu - heap_malloc(0) zwraca NULL
+inline void* przydziel(std::size_t bytes, std::size_t alignment) {
+    std::size_t rozmiar = bytes != 0 ? bytes : 1;
+    void* wynik = alignment <= wyrownanie ? heap_malloc(rozmiar) : heap_aligned_alloc(alignment, rozmiar);
+    if (wynik == nullptr) {
+        throw std::bad_alloc();
+    }
+    return wynik;
+}
+inline void zwolnij(void* p, std::size_t bytes) noexcept {
+    heap_free_sized(p, bytes != 0 ? bytes : 1);
+}
+
+class memory_resource final : public std::pmr::memory_resource {
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        return przydziel(bytes, alignment);
+    }
+    void do_deallocate(void* p, std::size_t bytes, std::size_t) override {
+        zwolnij(p, bytes);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        // Wszystkie obiekty korzystają z tej samej sterty głównej
+        return dynamic_cast<const memory_resource*>(&other) != nullptr;
+    }
+};
+
+// Wspólny zasób, np. dla std::pmr::set_default_resource(heap::resource())
+inline memory_resource* resource() noexcept {
+    static memory_resource zasob;
+    return &zasob;
+}
+
+template <class T>
+class allocator {
+public:
+    using value_type = T;
+
+    allocator() noexcept = default;
+    template <class U>
+    allocator(const allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        if (n > static_cast<std::size_t>(-1) / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T*>(przydziel(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* p, std::size_t n) noexcept {
+        zwolnij(p, n * sizeof(T));
+    }
+};
+
+template <class T, class U>
+bool operator==(const allocator<T>&, const allocator<U>&) noexcept {
+    return true;
+}
+template <class T, class U>
+bool operator!=(const allocator<T>&, const allocator<U>&) noexcept {
+    return false;
+}
+
+}
+
+#endif
@@ -0,0 +1,253 @@
+#include "heap.h"
+
+#include <sys/stat.h>
+
+// Zdarzenie śladu przetłumaczone na numer miejsca w tablicy obiektów - odtwarzanie nie szuka adresów
+struct krok_t {
+    uint32_t operacja;
+    uint32_t miejsce;
+    uint64_t rozmiar;
+};
+
+// Tablica mieszająca: identyfikator z nagrania -> numer miejsca żywego obiektu
+struct mapa_t {
+    uint64_t *klucze;
+    uint32_t *miejsca;
+    size_t pojemnosc;
+    size_t ile;
+};
+
+static size_t mapa_pozycja(const struct mapa_t *mapa, uint64_t klucz) {
+    size_t pozycja = (size_t) ((klucz >> 4) * 0x9e3779b97f4a7c15ull) & (mapa->pojemnosc - 1);
+    while (mapa->klucze[pozycja] != 0 && mapa->klucze[pozycja] != klucz) {
+        pozycja = (pozycja + 1) & (mapa->pojemnosc - 1);
+    }
+    return pozycja;
+}
+static void mapa_wstaw(struct mapa_t *mapa, uint64_t klucz, uint32_t miejsce);
+static void mapa_powieksz(struct mapa_t *mapa) {
+    struct mapa_t stara = *mapa;
+    mapa->pojemnosc = stara.pojemnosc ? stara.pojemnosc * 2 : 1024;
+    mapa->klucze = calloc(mapa->pojemnosc, sizeof(uint64_t));
+    mapa->miejsca = calloc(mapa->pojemnosc, sizeof(uint32_t));
+    mapa->ile = 0;
+    if (mapa->klucze == NULL || mapa->miejsca == NULL) {
+        fprintf(stderr, "brak pamięci na mapę obiektów\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < stara.pojemnosc; i++) {
+        if (stara.klucze[i] != 0) {
+            mapa_wstaw(mapa, stara.klucze[i], stara.miejsca[i]);
+        }
+    }
+    free(stara.klucze);
+    free(stara.miejsca);
+}
+static void mapa_wstaw(struct mapa_t *mapa, uint64_t klucz, uint32_t miejsce) {
+    if (2 * (mapa->ile + 1) > mapa->pojemnosc) {
+        mapa_powieksz(mapa);
+    }
+    size_t pozycja = mapa_pozycja(mapa, klucz);
+    if (mapa->klucze[pozycja] == 0) {
+        mapa->ile++;
+    }
+    mapa->klucze[pozycja] = klucz;
+    mapa->miejsca[pozycja] = miejsce;
+}
+static int mapa_usun(struct mapa_t *mapa, uint64_t klucz, uint32_t *miejsce) {
+    if (mapa->pojemnosc == 0) {
+        return 0;
+    }
+    size_t pozycja = mapa_pozycja(mapa, klucz);
+    if (mapa->klucze[pozycja] == 0) {
+        return 0;
+    }
+    *miejsce = mapa->miejsca[pozycja];
+
+    // Usunięcie z przesunięciem wstecz - kolejne klucze z tego samego ciągu wracają bliżej swoich pozycji
+    size_t luka = pozycja;
+    for (size_t i = (luka + 1) & (mapa->pojemnosc - 1); mapa->klucze[i] != 0; i = (i + 1) & (mapa->pojemnosc - 1)) {
+        size_t docelowa = (size_t) ((mapa->klucze[i] >> 4) * 0x9e3779b97f4a7c15ull) & (mapa->pojemnosc - 1);
+        if (((i - docelowa) & (mapa->pojemnosc - 1)) >= ((i - luka) & (mapa->pojemnosc - 1))) {
+            mapa->klucze[luka] = mapa->klucze[i];
+            mapa->miejsca[luka] = mapa->miejsca[i];
+            luka = i;
+        }
+    }
+    mapa->klucze[luka] = 0;
+    mapa->ile--;
+    return 1;
+}
+
+static size_t przygotuj(const struct heap_trace_event_t *zdarzenia, size_t ile, struct krok_t *kroki, size_t *miejsca) {
+    // Przed pomiarem identyfikatory zastępowane są numerami miejsc; miejsca zwolnionych obiektów są używane ponownie
+    struct mapa_t mapa = {0};
+    uint32_t *wolne_miejsca = malloc(ile * sizeof(uint32_t) + 1);
+    size_t wolnych = 0, uzyte = 0, krokow = 0;
+    if (wolne_miejsca == NULL) {
+        fprintf(stderr, "brak pamięci na przygotowanie śladu\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < ile; i++) {
+        const struct heap_trace_event_t *zdarzenie = &zdarzenia[i];
+        uint32_t miejsce;
+        switch (zdarzenie->operation) {
+            case heap_trace_malloc:
+            case heap_trace_calloc:
+                if (zdarzenie->id == 0) {
+                    break;
+                }
+                miejsce = wolnych ? wolne_miejsca[--wolnych] : (uint32_t) uzyte++;
+                mapa_wstaw(&mapa, zdarzenie->id, miejsce);
+                kroki[krokow++] = (struct krok_t) {zdarzenie->operation, miejsce, zdarzenie->size};
+                break;
+            case heap_trace_realloc:
+                // realloc(NULL, n) tworzy obiekt, realloc(p, 0) zwalnia go, a nieudany realloc go nie zmienia
+                if (zdarzenie->result == 0) {
+                    if (zdarzenie->size == 0 && zdarzenie->id != 0 && mapa_usun(&mapa, zdarzenie->id, &miejsce)) {
+                        wolne_miejsca[wolnych++] = miejsce;
+                        kroki[krokow++] = (struct krok_t) {heap_trace_free, miejsce, 0};
+                    }
+                    break;
+                }
+                if (zdarzenie->id == 0 || !mapa_usun(&mapa, zdarzenie->id, &miejsce)) {
+                    miejsce = wolnych ? wolne_miejsca[--wolnych] : (uint32_t) uzyte++;
+                    kroki[krokow++] = (struct krok_t) {heap_trace_malloc, miejsce, zdarzenie->size};
+                } else {
+                    kroki[krokow++] = (struct krok_t) {heap_trace_realloc, miejsce, zdarzenie->size};
+                }
+                mapa_wstaw(&mapa, zdarzenie->result, miejsce);
+                break;
+            case heap_trace_free:
+                // Zwolnienie obiektu spoza nagrania (przydzielonego przed jego rozpoczęciem) jest pomijane
+                if (zdarzenie->id == 0 || !mapa_usun(&mapa, zdarzenie->id, &miejsce)) {
+                    break;
+                }
+                wolne_miejsca[wolnych++] = miejsce;
+                kroki[krokow++] = (struct krok_t) {heap_trace_free, miejsce, 0};
+                break;
+            default:
+                break;
+        }
+    }
+
+    free(wolne_miejsca);
+    free(mapa.klucze);
+    free(mapa.miejsca);
+    *miejsca = uzyte;
+    return krokow;
+}
+
+static uint64_t teraz(void) {
+    struct timespec czas;
+    clock_gettime(CLOCK_MONOTONIC, &czas);
+    return (uint64_t) czas.tv_sec * 1000000000u + (uint64_t) czas.tv_nsec;
+}
+
+static void wypisz_probke(size_t krok, size_t zywe_bajty) {
+    // Zajętość sterty z liczników heap_stats; fragmentacja jako stosunek zajętej pamięci do żywych bajtów
+    struct heap_stats_t statystyki;
+    heap_stats(&statystyki);
+    size_t zajete = statystyki.heap_size + statystyki.mmap_bytes;
+    printf("%12zu %14zu %14zu %14zu %8.2f\n", krok, statystyki.heap_size, statystyki.mmap_bytes, zywe_bajty,
+           zywe_bajty ? (double) zajete / (double) zywe_bajty : 0.0);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "użycie: %s plik_sladu [liczba_probek]\n", argv[0]);
+        return 2;
+    }
+    size_t liczba_probek = argc > 2 ? strtoul(argv[2], NULL, 10) : 20;
+
+    // Cały ślad wczytywany jest przez odwzorowanie pliku
+    int plik = open(argv[1], O_RDONLY);
+    struct stat informacje;
+    if (plik < 0 || fstat(plik, &informacje) != 0 || (size_t) informacje.st_size < sizeof(struct heap_trace_header_t)) {
+        fprintf(stderr, "nie można odczytać %s\n", argv[1]);
+        return 1;
+    }
+    const char *dane = mmap(NULL, (size_t) informacje.st_size, PROT_READ, MAP_PRIVATE, plik, 0);
+    close(plik);
+    const struct heap_trace_header_t *naglowek = (const struct heap_trace_header_t *) dane;
+    if (dane == MAP_FAILED || naglowek->magic != HEAP_TRACE_MAGIC || naglowek->version != HEAP_TRACE_VERSION ||
+        naglowek->event_size != sizeof(struct heap_trace_event_t)) {
+        fprintf(stderr, "%s nie jest plikiem śladu w obsługiwanej wersji\n", argv[1]);
+        return 1;
+    }
+    size_t zdarzen = ((size_t) informacje.st_size - sizeof(*naglowek)) / sizeof(struct heap_trace_event_t);
+    const struct heap_trace_event_t *zdarzenia = (const struct heap_trace_event_t *) (dane + sizeof(*naglowek));
+
+    struct krok_t *kroki = malloc(zdarzen * sizeof(struct krok_t) + 1);
+    if (kroki == NULL) {
+        fprintf(stderr, "brak pamięci na odtworzenie śladu\n");
+        return 1;
+    }
+    size_t miejsc;
+    size_t krokow = przygotuj(zdarzenia, zdarzen, kroki, &miejsc);
+    void **obiekty = calloc(miejsc + 1, sizeof(void *));
+    size_t *rozmiary = calloc(miejsc + 1, sizeof(size_t));
+    if (obiekty == NULL || rozmiary == NULL) {
+        fprintf(stderr, "brak pamięci na odtworzenie śladu\n");
+        return 1;
+    }
+    if (heap_setup() != 0) {
+        fprintf(stderr, "heap_setup nie powiodło się\n");
+        return 1;
+    }
+    // Czas operacji ma dotyczyć samego alokatora, bez walidacji przy każdym wywołaniu i ze slabami
+    heap_configure(heap_option_validation, heap_validation_off);
+    heap_configure(heap_option_slabs, 1);
+
+    printf("%12s %14s %14s %14s %8s\n", "krok", "sterta", "mmap", "zywe", "frag");
+    size_t okres = liczba_probek ? (krokow + liczba_probek - 1) / liczba_probek : 0;
+    size_t szczyt_sterty = 0, zywe_bajty = 0;
+    uint64_t czas_operacji = 0, poczatek = teraz();
+    for (size_t i = 0; i < krokow; i++) {
+        const struct krok_t *krok = &kroki[i];
+        void **obiekt = &obiekty[krok->miejsce];
+        switch (krok->operacja) {
+            case heap_trace_malloc:
+                *obiekt = heap_malloc(krok->rozmiar);
+                break;
+            case heap_trace_calloc:
+                *obiekt = heap_calloc(1, krok->rozmiar);
+                break;
+            case heap_trace_realloc: {
+                void *nowy = heap_realloc(*obiekt, krok->rozmiar);
+                if (nowy == NULL) {
+                    continue;
+                }
+                *obiekt = nowy;
+                break;
+            }
+            case heap_trace_free:
+                heap_free(*obiekt);
+                *obiekt = NULL;
+                break;
+        }
+
+        // Szczytowa wielkość sterty po każdym kroku; próbki fragmentacji w równych odstępach (poza czasem operacji)
+        zywe_bajty += (*obiekt != NULL ? krok->rozmiar : 0) - rozmiary[krok->miejsce];
+        rozmiary[krok->miejsce] = *obiekt != NULL ? krok->rozmiar : 0;
+        if (memory_manager.wielkosc_pamieci > szczyt_sterty) {
+            szczyt_sterty = memory_manager.wielkosc_pamieci;
+        }
+        if (okres != 0 && (i + 1) % okres == 0) {
+            uint64_t przerwa = teraz();
+            czas_operacji += przerwa - poczatek;
+            wypisz_probke(i + 1, zywe_bajty);
+            poczatek = teraz();
+        }
+    }
+    czas_operacji += teraz() - poczatek;
+
+    double sekundy = (double) czas_operacji / 1e9;
+    printf("zdarzen: %zu, odtworzonych operacji: %zu, obiektow jednoczesnie: %zu\n", zdarzen, krokow, miejsc);
+    printf("przepustowosc: %.0f operacji/s (%.3f s)\n", sekundy > 0 ? (double) krokow / sekundy : 0.0, sekundy);
+    printf("szczytowa wielkosc sterty: %zu B\n", szczyt_sterty);
+
+    heap_clean();
+    return 0;
+}